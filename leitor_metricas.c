@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Leitor do arquivo de métricas por intervalo gravado por tomasuloCorrigido
+// (opção -o). Imprime as linhas em CSV na saída padrão. As colunas vêm dos
+// descritores do cabeçalho, então o leitor não precisa ser alterado quando
+// o simulador ganha colunas novas.
+//
+// Uso: leitor_metricas arquivo [coluna,coluna,...]
+
+#define VERSAO_METRICAS 1
+#define TAM_NOME_COLUNA 30
+#define MAX_COLUNAS 64
+
+typedef struct {
+    char nome[TAM_NOME_COLUNA + 1];
+    char tipo;        // 'i', 'u' ou 'f'
+    int tamanho;      // bytes
+    bool selecionada;
+    unsigned char *dados; // coluna do bloco atual
+} Coluna;
+
+Coluna colunas[MAX_COLUNAS];
+int qtd_colunas = 0;
+
+bool tipo_valido(char tipo, int tamanho) {
+    if (tipo == 'f')
+        return tamanho == 4 || tamanho == 8;
+    if (tipo == 'i' || tipo == 'u')
+        return tamanho == 1 || tamanho == 2 || tamanho == 4 || tamanho == 8;
+    return false;
+}
+
+// Todos os valores do arquivo (cabeçalho, contagens e colunas, inclusive
+// floats) estão em little-endian
+uint64_t ler_little_endian(const unsigned char *p, int tamanho) {
+    uint64_t v = 0;
+    for (int b = tamanho - 1; b >= 0; b--)
+        v = (v << 8) | p[b];
+    return v;
+}
+
+void imprimir_valor(const Coluna *c, uint32_t linha) {
+    const unsigned char *p = c->dados + (size_t)linha * (size_t)c->tamanho;
+    uint64_t v = ler_little_endian(p, c->tamanho);
+    if (c->tipo == 'f') {
+        if (c->tamanho == 4) {
+            uint32_t bits = (uint32_t)v;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            printf("%.6g", (double)f);
+        } else {
+            double d;
+            memcpy(&d, &v, sizeof(d));
+            printf("%.10g", d);
+        }
+        return;
+    }
+
+    if (c->tipo == 'i' && c->tamanho < 8 && (v >> (c->tamanho * 8 - 1)) & 1)
+        v |= ~(uint64_t)0 << (c->tamanho * 8); // estende o sinal
+    if (c->tipo == 'i')
+        printf("%lld", (long long)v);
+    else
+        printf("%llu", (unsigned long long)v);
+}
+
+// Marca as colunas citadas em 'lista' (separadas por vírgula)
+bool selecionar_colunas(char *lista) {
+    for (int c = 0; c < qtd_colunas; c++)
+        colunas[c].selecionada = false;
+    for (char *nome = strtok(lista, ","); nome != NULL; nome = strtok(NULL, ",")) {
+        int c = 0;
+        while (c < qtd_colunas && strcmp(colunas[c].nome, nome) != 0)
+            c++;
+        if (c == qtd_colunas) {
+            fprintf(stderr, "Coluna desconhecida: %s\n", nome);
+            return false;
+        }
+        colunas[c].selecionada = true;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Uso: %s arquivo [coluna,coluna,...]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Erro ao abrir o arquivo: %s\n", argv[1]);
+        return 1;
+    }
+
+    char magico[4];
+    unsigned char bytes[3 * 4];
+    if (fread(magico, 1, 4, f) != 4 || memcmp(magico, "TMET", 4) != 0 ||
+        fread(bytes, sizeof(bytes), 1, f) != 1) {
+        fprintf(stderr, "Arquivo de metricas invalido: %s\n", argv[1]);
+        return 1;
+    }
+    uint32_t cabecalho[3]; // versão, colunas, intervalo
+    for (int k = 0; k < 3; k++)
+        cabecalho[k] = (uint32_t)ler_little_endian(bytes + 4 * k, 4);
+    if (cabecalho[0] != VERSAO_METRICAS) {
+        fprintf(stderr, "Versao %u nao suportada (esperada %d)\n", cabecalho[0], VERSAO_METRICAS);
+        return 1;
+    }
+    if (cabecalho[1] == 0 || cabecalho[1] > MAX_COLUNAS) {
+        fprintf(stderr, "Numero de colunas invalido: %u\n", cabecalho[1]);
+        return 1;
+    }
+    qtd_colunas = (int)cabecalho[1];
+
+    for (int c = 0; c < qtd_colunas; c++) {
+        unsigned char descritor[TAM_NOME_COLUNA + 2];
+        if (fread(descritor, sizeof(descritor), 1, f) != 1) {
+            fprintf(stderr, "Cabecalho truncado\n");
+            return 1;
+        }
+        Coluna *col = &colunas[c];
+        memcpy(col->nome, descritor, TAM_NOME_COLUNA);
+        col->nome[TAM_NOME_COLUNA] = '\0';
+        col->tipo = (char)descritor[TAM_NOME_COLUNA];
+        col->tamanho = descritor[TAM_NOME_COLUNA + 1];
+        col->selecionada = true;
+        col->dados = NULL;
+        if (!tipo_valido(col->tipo, col->tamanho)) {
+            fprintf(stderr, "Coluna %s: tipo '%c' de %d bytes nao suportado\n", col->nome, col->tipo,
+                    col->tamanho);
+            return 1;
+        }
+    }
+
+    if (argc == 3 && !selecionar_colunas(argv[2]))
+        return 1;
+
+    // Cabeçalho do CSV
+    bool primeira = true;
+    for (int c = 0; c < qtd_colunas; c++) {
+        if (!colunas[c].selecionada)
+            continue;
+        printf("%s%s", primeira ? "" : ",", colunas[c].nome);
+        primeira = false;
+    }
+    printf("\n");
+
+    // Blocos até o fim do arquivo (o último pode ter ficado incompleto se a
+    // simulação foi interrompida; nesse caso ele é ignorado)
+    uint32_t capacidade = 0;
+    unsigned char bytes_linhas[4];
+    while (fread(bytes_linhas, sizeof(bytes_linhas), 1, f) == 1) {
+        uint32_t linhas = (uint32_t)ler_little_endian(bytes_linhas, 4);
+        if (linhas > capacidade) {
+            for (int c = 0; c < qtd_colunas; c++) {
+                free(colunas[c].dados);
+                colunas[c].dados = malloc((size_t)linhas * (size_t)colunas[c].tamanho);
+                if (colunas[c].dados == NULL) {
+                    fprintf(stderr, "Memoria insuficiente\n");
+                    return 1;
+                }
+            }
+            capacidade = linhas;
+        }
+
+        bool completo = true;
+        for (int c = 0; c < qtd_colunas && completo; c++)
+            completo = fread(colunas[c].dados, (size_t)colunas[c].tamanho, linhas, f) == linhas;
+        if (!completo) {
+            fprintf(stderr, "Aviso: ultimo bloco truncado, ignorado\n");
+            break;
+        }
+
+        for (uint32_t l = 0; l < linhas; l++) {
+            primeira = true;
+            for (int c = 0; c < qtd_colunas; c++) {
+                if (!colunas[c].selecionada)
+                    continue;
+                if (!primeira)
+                    printf(",");
+                imprimir_valor(&colunas[c], l);
+                primeira = false;
+            }
+            printf("\n");
+        }
+    }
+
+    for (int c = 0; c < qtd_colunas; c++)
+        free(colunas[c].dados);
+    fclose(f);
+    return 0;
+}
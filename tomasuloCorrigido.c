@@ -1,18 +1,86 @@
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 // Configuração da Arquitetura
-#define MAX_INSTR_MEM 16
+#define QTD_REGISTRADORES 8
+
+// Valores padrão (podem ser alterados na linha de comando)
 #define QTD_ESTACOES 10
 #define TAM_FILA_ROB 10
-#define QTD_REGISTRADORES 8
 #define N_ISSUE_POR_CICLO 8
 #define N_COMMIT_POR_CICLO 8
+#define MAX_CICLOS 1000
+#define BITS_PREDITOR 10     // log2 das entradas da tabela de contadores
+#define TAM_FILA_LSQ 16
+#define LARGURA_CDB 2        // resultados por ciclo
+#define JANELA_VERIFICACAO 1000 // commits por janela do verificador
+#define INTERVALO_METRICAS 1000 // ciclos por linha do arquivo de métricas
+
+// Unidades funcionais (quantidade de cada pool)
+#define QTD_UF_ALU 2
+#define QTD_UF_MUL 1         // pipelined
+#define QTD_UF_DIV 1         // não pipelined
+#define QTD_UF_MEM 1         // cálculo de endereço, pipelined
+
+// Hierarquia de memória (linha em palavras, latências em ciclos)
+#define L1_CONJUNTOS 64
+#define L1_VIAS 4
+#define L1_LINHA 8
+#define L1_LATENCIA 2
+#define L2_CONJUNTOS 512
+#define L2_VIAS 8
+#define L2_LINHA 8
+#define L2_LATENCIA 10
+#define LATENCIA_MEMORIA 100
+#define LATENCIA_ENCAMINHAMENTO 1   // store -> load dentro da LSQ
+#define BITS_PAGINA 16              // palavras por página da memória de dados
+
+// Com os valores padrão, alguns loads que falham nas duas caches têm de
+// caber no limite de ciclos
+_Static_assert(MAX_CICLOS > 4 * (L1_LATENCIA + L2_LATENCIA + LATENCIA_MEMORIA),
+               "MAX_CICLOS menor que alguns acessos frios a memoria");
+
+// Limites das tabelas alocadas estaticamente
+#define MAX_ESTACOES 64
+#define MAX_FILA_ROB 256
+#define MAX_BITS_PREDITOR 20
+#define MAX_FILA_LSQ 64
+#define MAX_UNIDADES_UF 16
+#define LINHAS_BLOCO_METRICAS 1024 // intervalos por bloco gravado
+
+// Montador
+#define MAX_DIAGNOSTICOS 20                     // erros exibidos por arquivo
+#define MAX_THREADS_MONTADOR 64
+#define TAM_MIN_MONTAGEM_PARALELA (4 << 20)     // bytes; abaixo disso, uma thread
+
+// Força a expansão das etapas em cada motor especializado, para que o
+// compilador enxergue os limites dos laços como constantes.
+#if defined(__GNUC__)
+#define SEMPRE_INLINE static inline __attribute__((always_inline))
+#else
+#define SEMPRE_INLINE static inline
+#endif
+
+// Desenrola os laços sobre as estações de reserva. Com -O2 o GCC não
+// desenrola sozinho, nem com o limite constante; 16 cobre por inteiro os
+// motores pequenos sem inflar demais os de 32/64 estações.
+#if defined(__GNUC__) && !defined(__clang__)
+#define DESENROLAR _Pragma("GCC unroll 16")
+#elif defined(__clang__)
+#define DESENROLAR _Pragma("clang loop unroll_count(16)")
+#else
+#define DESENROLAR
+#endif
 
 // Estruturas de Dados
 // Tipos de operação
-typedef enum { ADD, SUB, MUL, DIV, LI, HALT } OpType;
+typedef enum { ADD, SUB, MUL, DIV, LI, HALT, BEQ, BNE, BLT, JMP, LW, SW } OpType;
 
 // Instrução em "memória"
 typedef struct {
@@ -20,9 +88,11 @@ typedef struct {
     int rs1;
     int rs2; 
     int rd;
+    int alvo; // desvios: índice da instrução de destino
+    int imm;  // LI: valor; LW/SW: deslocamento
 } Operacao;
 
-Operacao memoria_instrucoes[MAX_INSTR_MEM];
+Operacao *memoria_instrucoes = NULL; // alocada pelo montador
 
 // Estação de Reserva (ER)
 typedef struct {
@@ -30,22 +100,68 @@ typedef struct {
     int tag_j, tag_k;
     int val_j, val_k;
     int rob_destino; 
+    int lsq_destino; // LW/SW
     int cycles_left;
+    int resultado;
     bool ocupado;
+    bool em_execucao; // já ocupou uma unidade funcional
+    bool concluida;   // resultado aguardando o CDB
 } SlotReserva;
 
-SlotReserva estacoes_reserva[QTD_ESTACOES];
+SlotReserva estacoes_reserva[MAX_ESTACOES];
 
 // Item do Buffer de Reordenação (ROB)
 typedef struct {
     OpType op;
-    int reg_arq_dest;
-    int valor;
+    int reg_arq_dest; // -1 para desvios
+    int valor;        // desvios: 1 se tomado
     bool pronto; 
     bool em_uso; 
+    int pc;
+    // Especulação (apenas desvios condicionais)
+    bool previsto_tomado;
+    bool mal_previsto;
+    unsigned historico;     // histórico global antes da previsão
+    long long ciclo_issue;
+    int penalidade;         // ciclos em caminho errado, se mal previsto
 } ItemROB;
 
-ItemROB fila_reordenacao[TAM_FILA_ROB];
+ItemROB fila_reordenacao[MAX_FILA_ROB];
+
+// Item da Fila de Loads/Stores (LSQ), em ordem de programa
+typedef struct {
+    OpType op;          // LW ou SW
+    int rob_idx;
+    int deslocamento;
+    unsigned endereco;
+    int dado;           // SW: valor a gravar; LW: valor lido
+    bool endereco_pronto;
+    bool dado_pronto;   // SW: dado conhecido; LW: leitura concluída
+    bool iniciado;      // LW: acesso em andamento
+    bool difundido;     // LW: valor já enviado pelo CDB
+    int cycles_left;
+} ItemLSQ;
+
+ItemLSQ fila_lsq[MAX_FILA_LSQ];
+
+// Pools de Unidades Funcionais
+typedef enum { UF_ALU, UF_MUL, UF_DIV, UF_MEM, QTD_TIPOS_UF } TipoUF;
+
+typedef struct {
+    const char *nome;
+    int quantidade;
+    bool pipelined; // aceita uma operação nova por ciclo
+    long long livre_em[MAX_UNIDADES_UF]; // ciclo em que a unidade aceita outra operação
+    long long operacoes;
+    long long esperas; // ERs prontas sem unidade livre (soma por ciclo)
+} PoolUF;
+
+PoolUF pools_uf[QTD_TIPOS_UF] = {
+    {"ALU", QTD_UF_ALU, true, {0}, 0, 0},
+    {"MUL", QTD_UF_MUL, true, {0}, 0, 0},
+    {"DIV", QTD_UF_DIV, false, {0}, 0, 0},
+    {"MEM", QTD_UF_MEM, true, {0}, 0, 0},
+};
 
 // Arquivo de Registradores
 typedef struct {
@@ -60,34 +176,125 @@ typedef struct {
     int rob_head;
     int rob_tail;
     int rob_contagem;
-    int ciclo;
+    long long ciclo;
+    int desvios_pendentes; // desvios condicionais ainda não resolvidos
+    unsigned historico;    // histórico global especulativo (gshare)
+    int lsq_head;
+    int lsq_tail;
+    int lsq_contagem;
 } UnidadeControle;
 
-UnidadeControle cpu_core = {0, 0, 0, 0, 1};
+UnidadeControle cpu_core = {0, 0, 0, 0, 1, 0, 0, 0, 0, 0};
+
+// Motivos de stall no issue (ciclos em que a emissão parou)
+typedef enum { STALL_ROB, STALL_ER, STALL_LSQ, STALL_ESPECULACAO, QTD_MOTIVOS_STALL } MotivoStall;
+
+// Contadores de desempenho
+typedef struct {
+    long long instrucoes;           // commitadas
+    long long desvios;              // desvios condicionais commitados
+    long long desvios_mal_previstos;
+    long long instrucoes_descartadas;
+    long long ciclos_caminho_errado;
+    long long loads, stores;
+    long long loads_encaminhados;   // servidos por store anterior na LSQ
+    long long esperas_desambiguacao; // ciclos de load à espera de endereço de store
+    long long esperas_cdb;          // resultados adiados por falta de vaga no CDB
+    long long stalls[QTD_MOTIVOS_STALL];
+} Estatisticas;
+
+Estatisticas estatisticas = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {0}};
+
+// Parâmetros da Máquina
+typedef struct {
+    int qtd_estacoes;
+    int tam_rob;
+    int n_issue;
+    int n_commit;
+    int max_ciclos; // 0 = sem limite
+    int threads;    // threads do montador, 0 = automático
+    int bits_preditor;
+    int max_especulacao; // desvios não resolvidos em voo, 0 = sem limite
+    int tam_lsq;
+    int largura_cdb; // 0 = sem limite
+    int taxa_verificacao; // % das janelas conferidas pelo verificador
+    const char *arquivo_metricas; // NULL = sem métricas por intervalo
+    int intervalo_metricas;
+    bool verboso;   // rastro ciclo a ciclo
+} ConfigMaquina;
+
+ConfigMaquina config = {QTD_ESTACOES, TAM_FILA_ROB, N_ISSUE_POR_CICLO, N_COMMIT_POR_CICLO, MAX_CICLOS, 0,
+                        BITS_PREDITOR, 0, TAM_FILA_LSQ, LARGURA_CDB, 0, NULL, INTERVALO_METRICAS, true};
+
+#define LOG(...) do { if (config.verboso) printf(__VA_ARGS__); } while (0)
 
 // Funções Auxiliares
 
-bool rob_cheio() {
-    return cpu_core.rob_contagem >= TAM_FILA_ROB;
+SEMPRE_INLINE bool rob_cheio(int n_rob) {
+    return cpu_core.rob_contagem >= n_rob;
 }
 
-int encontrar_er_livre() {
-    for (int i = 0; i < QTD_ESTACOES; i++) {
+SEMPRE_INLINE int encontrar_er_livre(int n_er) {
+    DESENROLAR
+    for (int i = 0; i < n_er; i++) {
         if (!estacoes_reserva[i].ocupado)
             return i;
     }
     return -1;
 }
 
-OpType decodificar_mnemonico(const char *mnemonic) {
-    if (strcmp(mnemonic, "ADD") == 0) return ADD;
-    if (strcmp(mnemonic, "MUL") == 0) return MUL;
-    if (strcmp(mnemonic, "SUB") == 0) return SUB;
-    if (strcmp(mnemonic, "DIV") == 0) return DIV;
-    if (strcmp(mnemonic, "LW") == 0) return LI; 
-    if (strcmp(mnemonic, "HALT") == 0) return HALT;
-    fprintf(stderr, "Instrucao desconhecida: %s\n", mnemonic);
-    return HALT;
+SEMPRE_INLINE void liberar_er(SlotReserva *er) {
+    er->ocupado = false;
+    er->em_execucao = er->concluida = false;
+    er->tag_j = er->tag_k = -1;
+    er->val_j = er->val_k = 0;
+    er->cycles_left = 0;
+}
+
+// Retorna uma unidade do pool livre neste ciclo, ou -1
+SEMPRE_INLINE int unidade_livre(const PoolUF *pool) {
+    for (int u = 0; u < pool->quantidade; u++) {
+        if (pool->livre_em[u] <= cpu_core.ciclo)
+            return u;
+    }
+    return -1;
+}
+
+// Próxima posição do anel do ROB. Para tamanhos potência de dois vira uma
+// máscara; nos demais, uma comparação (evita a divisão do '%').
+SEMPRE_INLINE int avancar_anel(int idx, int tam) {
+    if ((tam & (tam - 1)) == 0)
+        return (idx + 1) & (tam - 1);
+    return (idx + 1 == tam) ? 0 : idx + 1;
+}
+
+// Posição da entrada no ROB contando a partir da mais antiga (head)
+SEMPRE_INLINE int idade_rob(int idx, int n_rob) {
+    int d = idx - cpu_core.rob_head;
+    return d < 0 ? d + n_rob : d;
+}
+
+SEMPRE_INLINE bool eh_desvio_condicional(OpType op) {
+    return op == BEQ || op == BNE || op == BLT;
+}
+
+// Pool de unidades funcionais que executa cada operação
+SEMPRE_INLINE TipoUF tipo_uf(OpType op) {
+    switch (op) {
+        case MUL: return UF_MUL;
+        case DIV: return UF_DIV;
+        case LW:
+        case SW:  return UF_MEM;
+        default:  return UF_ALU;
+    }
+}
+
+// ER pronta para ocupar uma unidade. O SW usa a UF MEM só para calcular o
+// endereço (precisa apenas da base); o dado segue depois, sem unidade.
+SEMPRE_INLINE bool pronta_para_uf(const SlotReserva *er) {
+    if (er->op == SW)
+        return er->tag_j == -1 && !fila_lsq[er->lsq_destino].endereco_pronto;
+    return er->tag_j == -1 && er->tag_k == -1;
 }
 
 const char* nome_operacao(OpType op) {
@@ -96,8 +303,14 @@ const char* nome_operacao(OpType op) {
         case SUB: return "SUB";
         case MUL: return "MUL";
         case DIV: return "DIV";
-        case LI:  return "LW";
+        case LI:  return "LI";
         case HALT: return "HALT";
+        case BEQ: return "BEQ";
+        case BNE: return "BNE";
+        case BLT: return "BLT";
+        case JMP: return "J";
+        case LW:  return "LW";
+        case SW:  return "SW";
         default: return "???";
     }
 }
@@ -113,6 +326,513 @@ int latency_for_op(OpType op) {
     }
 }
 
+// Resultado das operações de ALU, definido para qualquer entrada (usado
+// pela execução e pelo verificador): soma, subtração e multiplicação dão
+// a volta em 32 bits, divisão por zero dá 0 e INT_MIN / -1 dá INT_MIN.
+// Desvios condicionais retornam 1 se tomados.
+SEMPRE_INLINE int calcular_operacao(OpType op, int a, int b) {
+    switch (op) {
+        case LI:
+        case ADD: return (int)((unsigned)a + (unsigned)b);
+        case SUB: return (int)((unsigned)a - (unsigned)b);
+        case MUL: return (int)((unsigned)a * (unsigned)b);
+        case DIV:
+            if (b == 0)
+                return 0;
+            if (b == -1)
+                return (int)(0u - (unsigned)a);
+            return a / b;
+        case BEQ: return a == b;
+        case BNE: return a != b;
+        case BLT: return a < b;
+        default:  return 0;
+    }
+}
+
+// Lê um operando: procura o produtor mais novo de 'reg' no ROB, do tail
+// para o head, parando no primeiro. Se o valor já estiver disponível,
+// copia para 'valor' e retorna -1; senão retorna a tag (índice no ROB) a
+// aguardar.
+SEMPRE_INLINE int ler_operando(int reg, int *valor, int n_rob) {
+    int produtor = -1;
+    int idx = cpu_core.rob_tail;
+    for (int k = 0; k < cpu_core.rob_contagem; k++) {
+        idx = (idx == 0 ? n_rob : idx) - 1;
+        if (fila_reordenacao[idx].reg_arq_dest == reg) {
+            produtor = idx;
+            break;
+        }
+    }
+
+    if (produtor == -1) {
+        *valor = registradores_arq.regs[reg];
+        return -1;
+    }
+    if (fila_reordenacao[produtor].pronto) {
+        *valor = fila_reordenacao[produtor].valor;
+        return -1;
+    }
+    *valor = 0;
+    return produtor;
+}
+
+// Memória de Dados
+// Esparsa: páginas alocadas na primeira escrita; posições nunca escritas
+// valem 0. Os endereços são em palavras.
+int *paginas_memoria[1 << (32 - BITS_PAGINA)];
+
+int ler_memoria(unsigned end) {
+    int *pagina = paginas_memoria[end >> BITS_PAGINA];
+    return pagina ? pagina[end & ((1u << BITS_PAGINA) - 1)] : 0;
+}
+
+void escrever_memoria(unsigned end, int valor) {
+    int **pagina = &paginas_memoria[end >> BITS_PAGINA];
+    if (*pagina == NULL) {
+        if (valor == 0)
+            return;
+        *pagina = calloc((size_t)1 << BITS_PAGINA, sizeof(int));
+        if (*pagina == NULL) {
+            fprintf(stderr, "Erro: memoria insuficiente para a memoria de dados\n");
+            exit(1);
+        }
+    }
+    (*pagina)[end & ((1u << BITS_PAGINA) - 1)] = valor;
+}
+
+// Caches
+// Modelo só de tempo (os dados ficam na memória de dados): associativa
+// por conjunto, substituição LRU, escrita com alocação.
+typedef struct {
+    const char *nome;
+    int conjuntos;   // 0 desativa o nível
+    int vias;
+    int linha;       // palavras por linha
+    int latencia;
+    unsigned *tags;  // endereço da linha, conjuntos * vias
+    long long *ultimo_uso;
+    bool *valido;
+    long long relogio;
+    long long acessos, faltas;
+} Cache;
+
+Cache cache_l1 = {"L1", L1_CONJUNTOS, L1_VIAS, L1_LINHA, L1_LATENCIA, NULL, NULL, NULL, 0, 0, 0};
+Cache cache_l2 = {"L2", L2_CONJUNTOS, L2_VIAS, L2_LINHA, L2_LATENCIA, NULL, NULL, NULL, 0, 0, 0};
+int latencia_memoria = LATENCIA_MEMORIA;
+
+bool iniciar_cache(Cache *c) {
+    if (c->conjuntos == 0)
+        return true;
+    size_t n = (size_t)c->conjuntos * (size_t)c->vias;
+    c->tags = calloc(n, sizeof(unsigned));
+    c->ultimo_uso = calloc(n, sizeof(long long));
+    c->valido = calloc(n, sizeof(bool));
+    return c->tags && c->ultimo_uso && c->valido;
+}
+
+// Retorna true em caso de acerto; na falta, a linha é trazida para a cache
+bool acessar_cache(Cache *c, unsigned end) {
+    unsigned linha = end / (unsigned)c->linha;
+    int base = (int)(linha & (unsigned)(c->conjuntos - 1)) * c->vias;
+    int vitima = base;
+
+    c->acessos++;
+    c->relogio++;
+    for (int v = base; v < base + c->vias; v++) {
+        if (c->valido[v] && c->tags[v] == linha) {
+            c->ultimo_uso[v] = c->relogio;
+            return true;
+        }
+        if (!c->valido[v] || (c->valido[vitima] && c->ultimo_uso[v] < c->ultimo_uso[vitima]))
+            vitima = v;
+    }
+
+    c->faltas++;
+    c->valido[vitima] = true;
+    c->tags[vitima] = linha;
+    c->ultimo_uso[vitima] = c->relogio;
+    return false;
+}
+
+// Latência de um acesso pela hierarquia L1 -> L2 -> memória
+int acessar_hierarquia(unsigned end, const char **nivel) {
+    int latencia = 0;
+    Cache *niveis[] = {&cache_l1, &cache_l2};
+    for (int i = 0; i < 2; i++) {
+        Cache *c = niveis[i];
+        if (c->conjuntos == 0)
+            continue;
+        latencia += c->latencia;
+        if (acessar_cache(c, end)) {
+            *nivel = c->nome;
+            return latencia;
+        }
+    }
+    *nivel = "memoria";
+    return latencia + latencia_memoria;
+}
+
+// Preditores de Desvio
+// Cada preditor prevê no issue e é treinado no commit. 'historico' é o
+// histórico global visto pelo desvio no momento da previsão.
+typedef struct {
+    const char *nome;
+    bool (*prever)(int pc, int alvo, unsigned historico);
+    void (*atualizar)(int pc, unsigned historico, bool tomado);
+} Preditor;
+
+unsigned char contadores_desvio[1 << MAX_BITS_PREDITOR]; // saturantes de 2 bits
+
+static void treinar_contador(unsigned idx, bool tomado) {
+    unsigned char *c = &contadores_desvio[idx];
+    if (tomado && *c < 3) (*c)++;
+    if (!tomado && *c > 0) (*c)--;
+}
+
+static unsigned indice_bimodal(int pc, unsigned historico) {
+    (void)historico;
+    return (unsigned)pc & ((1u << config.bits_preditor) - 1);
+}
+
+static unsigned indice_gshare(int pc, unsigned historico) {
+    return ((unsigned)pc ^ historico) & ((1u << config.bits_preditor) - 1);
+}
+
+// Estático: desvio para trás é tomado (laço), para frente não
+static bool prever_estatico(int pc, int alvo, unsigned historico) {
+    (void)historico;
+    return alvo <= pc;
+}
+
+static void atualizar_estatico(int pc, unsigned historico, bool tomado) {
+    (void)pc; (void)historico; (void)tomado;
+}
+
+static bool prever_bimodal(int pc, int alvo, unsigned historico) {
+    (void)alvo;
+    return contadores_desvio[indice_bimodal(pc, historico)] >= 2;
+}
+
+static void atualizar_bimodal(int pc, unsigned historico, bool tomado) {
+    treinar_contador(indice_bimodal(pc, historico), tomado);
+}
+
+static bool prever_gshare(int pc, int alvo, unsigned historico) {
+    (void)alvo;
+    return contadores_desvio[indice_gshare(pc, historico)] >= 2;
+}
+
+static void atualizar_gshare(int pc, unsigned historico, bool tomado) {
+    treinar_contador(indice_gshare(pc, historico), tomado);
+}
+
+static const Preditor preditores[] = {
+    {"estatico", prever_estatico, atualizar_estatico},
+    {"bimodal", prever_bimodal, atualizar_bimodal},
+    {"gshare", prever_gshare, atualizar_gshare},
+};
+
+const Preditor *preditor = &preditores[1];
+
+const Preditor *buscar_preditor(const char *nome) {
+    for (size_t i = 0; i < sizeof(preditores) / sizeof(preditores[0]); i++) {
+        if (strcmp(preditores[i].nome, nome) == 0)
+            return &preditores[i];
+    }
+    return NULL;
+}
+
+// Verificador (co-simulação)
+// Um modelo funcional executa o programa em passo com o commit e confere
+// cada instrução que sai do ROB. O fluxo de commits é dividido em janelas
+// de JANELA_VERIFICACAO; só 'taxa_verificacao'% delas são conferidas,
+// espaçadas de forma uniforme. No início de cada janela conferida o modelo
+// copia o estado arquitetural (registradores e PC do commit). Loads leem a
+// memória de dados, que no commit já reflete todos os stores anteriores.
+typedef struct {
+    bool ativo;          // janela atual conferida
+    int restantes;       // commits até o fim da janela
+    int credito;         // saldo da taxa: a janela é conferida quando fica positivo
+    int pc;              // próximo PC esperado
+    int regs[QTD_REGISTRADORES];
+    long long janelas, janelas_conferidas, commits_conferidos;
+} Verificador;
+
+Verificador verificador = {false, 0, 0, 0, {0}, 0, 0, 0};
+
+void relatar_divergencia(const ItemROB *item, int rob_idx, const char *formato, ...) {
+    va_list args;
+    fprintf(stderr, "Divergencia no ciclo %lld: PC=%d, ROB[%d] (%s): ", cpu_core.ciclo, item->pc,
+            rob_idx, nome_operacao(item->op));
+    va_start(args, formato);
+    vfprintf(stderr, formato, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+// Confere o commit de 'item' antes que ele altere o estado arquitetural
+void verificar_commit(const ItemROB *item, int rob_idx) {
+    Verificador *v = &verificador;
+    if (v->restantes == 0) {
+        v->janelas++;
+        v->restantes = JANELA_VERIFICACAO;
+        v->credito += config.taxa_verificacao;
+        v->ativo = v->credito > 0;
+        if (v->ativo) {
+            v->credito -= 100;
+            v->janelas_conferidas++;
+            memcpy(v->regs, registradores_arq.regs, sizeof(v->regs));
+            v->pc = item->pc;
+        }
+    }
+    v->restantes--;
+    if (!v->ativo)
+        return;
+    v->commits_conferidos++;
+
+    if (item->pc != v->pc)
+        relatar_divergencia(item, rob_idx, "esperado PC=%d", v->pc);
+
+    Operacao instr = memoria_instrucoes[v->pc];
+    int a = v->regs[instr.rs1], b = v->regs[instr.rs2];
+    int esperado = 0;
+    v->pc++;
+    switch (instr.op) {
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV: esperado = calcular_operacao(instr.op, a, b); break;
+        case LI:  esperado = instr.imm; break;
+        case LW:  esperado = ler_memoria((unsigned)a + (unsigned)instr.imm); break;
+        case JMP: v->pc = instr.alvo; return;
+        case SW: {
+            const ItemLSQ *m = &fila_lsq[cpu_core.lsq_head];
+            unsigned endereco = (unsigned)a + (unsigned)instr.imm;
+            if (m->endereco != endereco || m->dado != b)
+                relatar_divergencia(item, rob_idx, "esperado MEM[%u] <- %d, obtido MEM[%u] <- %d",
+                                    endereco, b, m->endereco, m->dado);
+            return;
+        }
+        case BEQ:
+        case BNE:
+        case BLT: {
+            bool tomado = calcular_operacao(instr.op, a, b) != 0;
+            if ((item->valor != 0) != tomado)
+                relatar_divergencia(item, rob_idx, "esperado %s, obtido %s",
+                                    tomado ? "tomado" : "nao tomado",
+                                    item->valor ? "tomado" : "nao tomado");
+            if (tomado)
+                v->pc = instr.alvo;
+            return;
+        }
+        default:
+            relatar_divergencia(item, rob_idx, "operacao inesperada no commit");
+    }
+
+    if (item->reg_arq_dest != instr.rd || item->valor != esperado)
+        relatar_divergencia(item, rob_idx, "esperado R%d <- %d, obtido R%d <- %d", instr.rd, esperado,
+                            item->reg_arq_dest, item->valor);
+    v->regs[instr.rd] = esperado;
+}
+
+// Métricas por Intervalo
+// A cada 'intervalo' ciclos uma linha é acrescentada ao bloco em memória;
+// o bloco é gravado (e o arquivo esvaziado com fflush) a cada
+// LINHAS_BLOCO_METRICAS linhas e no fim da simulação. Formato colunar,
+// com inteiros e floats em little-endian:
+//   cabeçalho: "TMET", versão (u32), número de colunas (u32), intervalo (u32)
+//   descritor por coluna (32 bytes): nome (30 bytes, com '\0'), tipo
+//     ('i', 'u' ou 'f') e tamanho em bytes (u8)
+//   blocos: número de linhas (u32), seguido de cada coluna contígua
+// O leitor (leitor_metricas.c) e o numpy usam os descritores, então novas
+// colunas só precisam ser acrescentadas aqui.
+#define VERSAO_METRICAS 1
+#define TAM_NOME_COLUNA 30
+
+// Formato: X(nome, tipo, tipo em C)
+#define COLUNAS_METRICAS(X) \
+    X(ciclo, 'i', int64_t)          /* último ciclo do intervalo */ \
+    X(ciclos, 'u', uint32_t)        /* ciclos no intervalo (o último pode ser menor) */ \
+    X(commits, 'u', uint32_t)       \
+    X(ipc, 'f', float)              \
+    X(ocupacao_rob, 'f', float)     /* médias por ciclo */ \
+    X(ocupacao_er, 'f', float)      \
+    X(ocupacao_lsq, 'f', float)     \
+    X(ciclos_sem_commit, 'u', uint32_t) \
+    X(ciclos_commit_cheio, 'u', uint32_t) /* ciclos com n_commit commits */ \
+    X(stall_rob, 'u', uint32_t)     \
+    X(stall_er, 'u', uint32_t)      \
+    X(stall_lsq, 'u', uint32_t)     \
+    X(stall_especulacao, 'u', uint32_t) \
+    X(esperas_uf, 'u', uint32_t)    \
+    X(esperas_cdb, 'u', uint32_t)   \
+    X(desvios, 'u', uint32_t)       \
+    X(desvios_mal_previstos, 'u', uint32_t) \
+    X(faltas_l1, 'u', uint32_t)
+
+typedef struct {
+#define DECLARAR_COLUNA(nome, tipo, tipo_c) tipo_c nome[LINHAS_BLOCO_METRICAS];
+    COLUNAS_METRICAS(DECLARAR_COLUNA)
+#undef DECLARAR_COLUNA
+} BlocoMetricas;
+
+typedef struct {
+    FILE *arquivo;        // NULL = métricas desligadas
+    int linhas;           // linhas no bloco atual
+    long long ciclo_inicio;
+    long long soma_rob, soma_er, soma_lsq;
+    uint32_t ciclos_sem_commit, ciclos_commit_cheio;
+    long long instrucoes_ciclo; // commits até o ciclo anterior
+    Estatisticas anterior;      // contadores no início do intervalo
+    long long esperas_uf_anterior, faltas_l1_anterior;
+    BlocoMetricas bloco;
+} Metricas;
+
+Metricas metricas; // zerada; preenchida por abrir_metricas()
+
+long long total_esperas_uf(void) {
+    long long total = 0;
+    for (int t = 0; t < QTD_TIPOS_UF; t++)
+        total += pools_uf[t].esperas;
+    return total;
+}
+
+// Grava 'n' valores de 'tamanho' bytes em little-endian, qualquer que seja
+// a ordem de bytes do host. Floats são convertidos pelo mesmo caminho dos
+// inteiros do mesmo tamanho.
+bool gravar_little_endian(FILE *f, const void *valores, size_t tamanho, uint32_t n) {
+    static unsigned char buffer[LINHAS_BLOCO_METRICAS * sizeof(uint64_t)];
+    const unsigned char *p = valores;
+    for (uint32_t l = 0; l < n; l++, p += tamanho) {
+        uint64_t v;
+        switch (tamanho) {
+            case 1: { uint8_t x; memcpy(&x, p, 1); v = x; break; }
+            case 2: { uint16_t x; memcpy(&x, p, 2); v = x; break; }
+            case 4: { uint32_t x; memcpy(&x, p, 4); v = x; break; }
+            default: memcpy(&v, p, 8); break;
+        }
+        for (size_t b = 0; b < tamanho; b++)
+            buffer[l * tamanho + b] = (unsigned char)(v >> (8 * b));
+    }
+    return fwrite(buffer, tamanho, n, f) == n;
+}
+
+bool abrir_metricas(const char *nome) {
+    FILE *f = fopen(nome, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Erro ao criar arquivo de metricas: %s\n", nome);
+        return false;
+    }
+    uint32_t cabecalho[3] = {VERSAO_METRICAS, 0, (uint32_t)config.intervalo_metricas};
+#define CONTAR_COLUNA(nome, tipo, tipo_c) cabecalho[1]++;
+    COLUNAS_METRICAS(CONTAR_COLUNA)
+#undef CONTAR_COLUNA
+    fwrite("TMET", 1, 4, f);
+    gravar_little_endian(f, cabecalho, sizeof(cabecalho[0]), 3);
+#define DESCREVER_COLUNA(nome, tipo, tipo_c) { \
+        char descritor[TAM_NOME_COLUNA + 2] = {0}; \
+        strncpy(descritor, #nome, TAM_NOME_COLUNA - 1); \
+        descritor[TAM_NOME_COLUNA] = tipo; \
+        descritor[TAM_NOME_COLUNA + 1] = (char)sizeof(tipo_c); \
+        fwrite(descritor, sizeof(descritor), 1, f); \
+    }
+    COLUNAS_METRICAS(DESCREVER_COLUNA)
+#undef DESCREVER_COLUNA
+    metricas.arquivo = f;
+    metricas.ciclo_inicio = cpu_core.ciclo;
+    return true;
+}
+
+void gravar_bloco_metricas(void) {
+    Metricas *mt = &metricas;
+    uint32_t linhas = (uint32_t)mt->linhas;
+    bool ok = gravar_little_endian(mt->arquivo, &linhas, sizeof(linhas), 1);
+#define GRAVAR_COLUNA(nome, tipo, tipo_c) \
+    ok = ok && gravar_little_endian(mt->arquivo, mt->bloco.nome, sizeof(tipo_c), linhas);
+    COLUNAS_METRICAS(GRAVAR_COLUNA)
+#undef GRAVAR_COLUNA
+    if (!ok || fflush(mt->arquivo) != 0) {
+        fprintf(stderr, "Erro ao gravar metricas; gravacao interrompida\n");
+        fclose(mt->arquivo);
+        mt->arquivo = NULL;
+    }
+    mt->linhas = 0;
+}
+
+// Fecha o intervalo que vai de 'ciclo_inicio' a 'ultimo_ciclo'
+void fechar_intervalo(long long ultimo_ciclo) {
+    Metricas *mt = &metricas;
+    const Estatisticas *a = &mt->anterior;
+    int n = mt->linhas;
+    long long ciclos = ultimo_ciclo - mt->ciclo_inicio + 1;
+    long long commits = estatisticas.instrucoes - a->instrucoes;
+    long long esperas_uf = total_esperas_uf();
+
+    mt->bloco.ciclo[n] = ultimo_ciclo;
+    mt->bloco.ciclos[n] = (uint32_t)ciclos;
+    mt->bloco.commits[n] = (uint32_t)commits;
+    mt->bloco.ipc[n] = (float)commits / (float)ciclos;
+    mt->bloco.ocupacao_rob[n] = (float)mt->soma_rob / (float)ciclos;
+    mt->bloco.ocupacao_er[n] = (float)mt->soma_er / (float)ciclos;
+    mt->bloco.ocupacao_lsq[n] = (float)mt->soma_lsq / (float)ciclos;
+    mt->bloco.ciclos_sem_commit[n] = mt->ciclos_sem_commit;
+    mt->bloco.ciclos_commit_cheio[n] = mt->ciclos_commit_cheio;
+    mt->bloco.stall_rob[n] = (uint32_t)(estatisticas.stalls[STALL_ROB] - a->stalls[STALL_ROB]);
+    mt->bloco.stall_er[n] = (uint32_t)(estatisticas.stalls[STALL_ER] - a->stalls[STALL_ER]);
+    mt->bloco.stall_lsq[n] = (uint32_t)(estatisticas.stalls[STALL_LSQ] - a->stalls[STALL_LSQ]);
+    mt->bloco.stall_especulacao[n] =
+        (uint32_t)(estatisticas.stalls[STALL_ESPECULACAO] - a->stalls[STALL_ESPECULACAO]);
+    mt->bloco.esperas_uf[n] = (uint32_t)(esperas_uf - mt->esperas_uf_anterior);
+    mt->bloco.esperas_cdb[n] = (uint32_t)(estatisticas.esperas_cdb - a->esperas_cdb);
+    mt->bloco.desvios[n] = (uint32_t)(estatisticas.desvios - a->desvios);
+    mt->bloco.desvios_mal_previstos[n] =
+        (uint32_t)(estatisticas.desvios_mal_previstos - a->desvios_mal_previstos);
+    mt->bloco.faltas_l1[n] = (uint32_t)(cache_l1.faltas - mt->faltas_l1_anterior);
+
+    mt->anterior = estatisticas;
+    mt->esperas_uf_anterior = esperas_uf;
+    mt->faltas_l1_anterior = cache_l1.faltas;
+    mt->ciclo_inicio = ultimo_ciclo + 1;
+    mt->soma_rob = mt->soma_er = mt->soma_lsq = 0;
+    mt->ciclos_sem_commit = mt->ciclos_commit_cheio = 0;
+
+    if (++mt->linhas == LINHAS_BLOCO_METRICAS)
+        gravar_bloco_metricas();
+}
+
+// Chamada ao fim de cada ciclo
+void amostrar_metricas(void) {
+    Metricas *mt = &metricas;
+    int ers_ocupadas = 0;
+    for (int i = 0; i < config.qtd_estacoes; i++)
+        ers_ocupadas += estacoes_reserva[i].ocupado;
+    mt->soma_rob += cpu_core.rob_contagem;
+    mt->soma_er += ers_ocupadas;
+    mt->soma_lsq += cpu_core.lsq_contagem;
+
+    long long commits = estatisticas.instrucoes - mt->instrucoes_ciclo;
+    mt->instrucoes_ciclo = estatisticas.instrucoes;
+    mt->ciclos_sem_commit += commits == 0;
+    mt->ciclos_commit_cheio += commits == config.n_commit;
+
+    if (cpu_core.ciclo - mt->ciclo_inicio + 1 >= config.intervalo_metricas)
+        fechar_intervalo(cpu_core.ciclo);
+}
+
+// Grava o intervalo incompleto e o último bloco
+void finalizar_metricas(long long ultimo_ciclo) {
+    if (metricas.arquivo == NULL)
+        return;
+    if (ultimo_ciclo >= metricas.ciclo_inicio)
+        fechar_intervalo(ultimo_ciclo);
+    if (metricas.linhas > 0)
+        gravar_bloco_metricas();
+    if (metricas.arquivo != NULL)
+        fclose(metricas.arquivo);
+    metricas.arquivo = NULL;
+}
+
 // Funções de Impressão
 
 void mostrar_banco_regs() {
@@ -130,7 +850,7 @@ void mostrar_estacoes_reserva() {
     printf("------ Estado das Estacoes de Reserva ------\n");
     printf("ID | Op  | Busy | ROB | Vj | Vk | Qj | Qk\n");
     printf("--------------------------------------------\n");
-    for (int i = 0; i < QTD_ESTACOES; i++) {
+    for (int i = 0; i < config.qtd_estacoes; i++) {
         SlotReserva *er = &estacoes_reserva[i];
         printf("%2d | %-3s |  %3s | %3d | %2d | %2d | %2d | %2d\n",
             i,
@@ -154,223 +874,1548 @@ void mostrar_regs_final() {
     printf("\n");
 }
 
+void mostrar_estatisticas(long long ciclos) {
+    printf("ESTATISTICAS\n");
+    printf("Ciclos: %lld\n", ciclos);
+    printf("Instrucoes commitadas: %lld (IPC %.3f)\n", estatisticas.instrucoes,
+           ciclos > 0 ? (double)estatisticas.instrucoes / (double)ciclos : 0.0);
+    if (estatisticas.desvios > 0) {
+        printf("Desvios: %lld, mal previstos: %lld (acerto %.2f%%, preditor %s)\n",
+               estatisticas.desvios, estatisticas.desvios_mal_previstos,
+               100.0 * (double)(estatisticas.desvios - estatisticas.desvios_mal_previstos) /
+                   (double)estatisticas.desvios,
+               preditor->nome);
+        printf("Descarte: %lld instrucoes, %lld ciclos em caminho errado\n",
+               estatisticas.instrucoes_descartadas, estatisticas.ciclos_caminho_errado);
+    }
+    for (int t = 0; t < QTD_TIPOS_UF; t++) {
+        PoolUF *pool = &pools_uf[t];
+        printf("UF %s: %d unidade(s)%s, %lld operacoes, %lld esperas por unidade livre\n", pool->nome,
+               pool->quantidade, pool->pipelined ? " pipelined" : "", pool->operacoes, pool->esperas);
+    }
+    printf("Stalls no issue: ROB cheio %lld, ERs cheias %lld, LSQ cheia %lld, limite de especulacao %lld\n",
+           estatisticas.stalls[STALL_ROB], estatisticas.stalls[STALL_ER], estatisticas.stalls[STALL_LSQ],
+           estatisticas.stalls[STALL_ESPECULACAO]);
+    if (config.largura_cdb > 0)
+        printf("CDB: %d resultado(s) por ciclo, %lld esperas por vaga\n", config.largura_cdb,
+               estatisticas.esperas_cdb);
+    if (estatisticas.loads + estatisticas.stores > 0) {
+        printf("Memoria: %lld loads (%lld encaminhados), %lld stores, %lld ciclos de load aguardando desambiguacao\n",
+               estatisticas.loads, estatisticas.loads_encaminhados, estatisticas.stores,
+               estatisticas.esperas_desambiguacao);
+        Cache *niveis[] = {&cache_l1, &cache_l2};
+        for (int i = 0; i < 2; i++) {
+            Cache *c = niveis[i];
+            if (c->acessos > 0)
+                printf("%s: %lld acessos, %lld faltas (acerto %.2f%%)\n", c->nome, c->acessos, c->faltas,
+                       100.0 * (double)(c->acessos - c->faltas) / (double)c->acessos);
+        }
+    }
+    if (config.taxa_verificacao > 0)
+        printf("Verificador: %lld de %lld janelas conferidas (%lld commits), sem divergencias\n",
+               verificador.janelas_conferidas, verificador.janelas, verificador.commits_conferidos);
+}
+
 // Estágios do Pipeline
+// Os limites (n_er, n_rob, n_issue, n_commit, n_lsq) chegam como parâmetros:
+// nos motores especializados são constantes. Os laços sobre as estações de
+// reserva levam DESENROLAR; os demais ficam a cargo do compilador.
 
 // Estágio 1: Despacho (Issue)
-void etapa_despacho(int instr_count) {
+SEMPRE_INLINE void etapa_despacho(int instr_count, int n_er, int n_rob, int n_issue, int n_lsq) {
     int emitidas = 0;
 
-    while (emitidas < N_ISSUE_POR_CICLO && cpu_core.pc < instr_count) {
+    while (emitidas < n_issue && cpu_core.pc < instr_count) {
         Operacao instr_atual = memoria_instrucoes[cpu_core.pc];
         if (instr_atual.op == HALT) {
             return;
         }
 
-        if (rob_cheio()) {
-            printf("Stall: ROB cheio.\n");
+        if (rob_cheio(n_rob)) {
+            estatisticas.stalls[STALL_ROB]++;
+            LOG("Stall: ROB cheio.\n");
             return;
         }
 
-        int er_idx = encontrar_er_livre();
-        if (er_idx == -1) {
-            printf("Stall: Estacoes de reserva cheias.\n");
+        bool condicional = eh_desvio_condicional(instr_atual.op);
+        if (condicional && config.max_especulacao > 0 &&
+            cpu_core.desvios_pendentes >= config.max_especulacao) {
+            estatisticas.stalls[STALL_ESPECULACAO]++;
+            LOG("Stall: limite de especulacao.\n");
             return;
         }
 
-        // Aloca entrada no ROB
-        int rob_idx = cpu_core.rob_tail;
-        fila_reordenacao[rob_idx].op = instr_atual.op;
-        fila_reordenacao[rob_idx].reg_arq_dest = instr_atual.rd;
-        fila_reordenacao[rob_idx].pronto = false;
-        fila_reordenacao[rob_idx].em_uso = true;
+        // Salto incondicional: não usa ER, redireciona a busca já no issue
+        if (instr_atual.op == JMP) {
+            int rob_idx = cpu_core.rob_tail;
+            ItemROB *item = &fila_reordenacao[rob_idx];
+            item->op = JMP;
+            item->reg_arq_dest = -1;
+            item->pc = cpu_core.pc;
+            item->pronto = true;
+            item->em_uso = true;
+            item->mal_previsto = false;
+            cpu_core.rob_tail = avancar_anel(cpu_core.rob_tail, n_rob);
+            cpu_core.rob_contagem++;
 
-        cpu_core.rob_tail = (cpu_core.rob_tail + 1) % TAM_FILA_ROB;
-        cpu_core.rob_contagem++;
+            LOG("Issue: PC=%d -> ROB[%d], J %d\n", cpu_core.pc, rob_idx, instr_atual.alvo);
+            cpu_core.pc = instr_atual.alvo;
+            emitidas++;
+            continue;
+        }
+
+        int er_idx = encontrar_er_livre(n_er);
+        if (er_idx == -1) {
+            estatisticas.stalls[STALL_ER]++;
+            LOG("Stall: Estacoes de reserva cheias.\n");
+            return;
+        }
 
-        // Preenche Estação de Reserva
+        bool acesso_memoria = instr_atual.op == LW || instr_atual.op == SW;
+        if (acesso_memoria && cpu_core.lsq_contagem >= n_lsq) {
+            estatisticas.stalls[STALL_LSQ]++;
+            LOG("Stall: LSQ cheia.\n");
+            return;
+        }
+
+        // Preenche Estação de Reserva (operandos lidos antes de alocar o
+        // ROB, para que a instrução não dependa de si mesma)
         SlotReserva *er = &estacoes_reserva[er_idx];
         er->ocupado = true;
         er->op = instr_atual.op;
-        er->rob_destino = rob_idx;
         er->cycles_left = 0;
-        er->tag_j = er->tag_k = -1;
-        er->val_j = er->val_k = 0;
-
-        // Dependências
-        for (int i = 0; i < TAM_FILA_ROB; i++) {
-            if (fila_reordenacao[i].em_uso && !fila_reordenacao[i].pronto) {
-                if (fila_reordenacao[i].reg_arq_dest == instr_atual.rs1)
-                    er->tag_j = i;
-                if (fila_reordenacao[i].reg_arq_dest == instr_atual.rs2)
-                    er->tag_k = i;
-            }
+        er->em_execucao = er->concluida = false;
+        if (instr_atual.op == LI) {
+            er->tag_j = er->tag_k = -1;
+            er->val_j = 0;
+            er->val_k = instr_atual.imm;
+        } else {
+            er->tag_j = ler_operando(instr_atual.rs1, &er->val_j, n_rob);
+            if (instr_atual.op == LW) {
+                er->tag_k = -1;
+                er->val_k = 0;
+            } else
+                er->tag_k = ler_operando(instr_atual.rs2, &er->val_k, n_rob);
         }
 
-        if (er->tag_j == -1) er->val_j = registradores_arq.regs[instr_atual.rs1];
-        if (instr_atual.op == LI) {
-            er->val_k = instr_atual.rs2;
-            er->tag_k = -1;
-        } else if (er->tag_k == -1)
-            er->val_k = registradores_arq.regs[instr_atual.rs2];
+        // Aloca entrada no ROB
+        int rob_idx = cpu_core.rob_tail;
+        ItemROB *item = &fila_reordenacao[rob_idx];
+        item->op = instr_atual.op;
+        item->reg_arq_dest = (condicional || instr_atual.op == SW) ? -1 : instr_atual.rd;
+        item->pc = cpu_core.pc;
+        item->pronto = false;
+        item->em_uso = true;
+        item->mal_previsto = false;
+        er->rob_destino = rob_idx;
+
+        cpu_core.rob_tail = avancar_anel(cpu_core.rob_tail, n_rob);
+        cpu_core.rob_contagem++;
 
-        printf("Issue: PC=%d -> ER[%d], ROB[%d], R%d = R%d %s R%d\n",
-            cpu_core.pc, er_idx, rob_idx, instr_atual.rd,
-            instr_atual.rs1, nome_operacao(instr_atual.op), instr_atual.rs2);
+        // Aloca entrada na LSQ, em ordem de programa
+        int lsq_idx = -1;
+        if (acesso_memoria) {
+            lsq_idx = cpu_core.lsq_tail;
+            ItemLSQ *m = &fila_lsq[lsq_idx];
+            m->op = instr_atual.op;
+            m->rob_idx = rob_idx;
+            m->deslocamento = instr_atual.imm;
+            m->endereco_pronto = m->dado_pronto = m->iniciado = m->difundido = false;
+            cpu_core.lsq_tail = avancar_anel(cpu_core.lsq_tail, n_lsq);
+            cpu_core.lsq_contagem++;
+        }
+        er->lsq_destino = lsq_idx;
 
-        cpu_core.pc++;
+        if (condicional) {
+            // Previsão: a busca segue pelo caminho previsto
+            item->historico = cpu_core.historico;
+            item->previsto_tomado = preditor->prever(cpu_core.pc, instr_atual.alvo, cpu_core.historico);
+            item->ciclo_issue = cpu_core.ciclo;
+            cpu_core.historico = (cpu_core.historico << 1) | item->previsto_tomado;
+            cpu_core.desvios_pendentes++;
+
+            LOG("Issue: PC=%d -> ER[%d], ROB[%d], %s R%d, R%d -> %d (previsto: %s)\n",
+                cpu_core.pc, er_idx, rob_idx, nome_operacao(instr_atual.op),
+                instr_atual.rs1, instr_atual.rs2, instr_atual.alvo,
+                item->previsto_tomado ? "tomado" : "nao tomado");
+            cpu_core.pc = item->previsto_tomado ? instr_atual.alvo : cpu_core.pc + 1;
+        } else if (acesso_memoria) {
+            LOG("Issue: PC=%d -> ER[%d], ROB[%d], LSQ[%d], %s R%d, R%d (%d)\n",
+                cpu_core.pc, er_idx, rob_idx, lsq_idx, nome_operacao(instr_atual.op),
+                instr_atual.op == LW ? instr_atual.rd : instr_atual.rs2, instr_atual.rs1, instr_atual.imm);
+            cpu_core.pc++;
+        } else if (instr_atual.op == LI) {
+            LOG("Issue: PC=%d -> ER[%d], ROB[%d], R%d = %d\n",
+                cpu_core.pc, er_idx, rob_idx, instr_atual.rd, instr_atual.imm);
+            cpu_core.pc++;
+        } else {
+            LOG("Issue: PC=%d -> ER[%d], ROB[%d], R%d = R%d %s R%d\n",
+                cpu_core.pc, er_idx, rob_idx, instr_atual.rd,
+                instr_atual.rs1, nome_operacao(instr_atual.op), instr_atual.rs2);
+            cpu_core.pc++;
+        }
         emitidas++;
     }
 }
 
+// Descarta as entradas do ROB mais novas que 'rob_idx' e as ERs que as produziriam
+SEMPRE_INLINE void descartar_mais_novas(int rob_idx, int n_er, int n_rob, int n_lsq) {
+    int idade = idade_rob(rob_idx, n_rob);
+    int descartadas = cpu_core.rob_contagem - idade - 1;
+
+    int idx = rob_idx;
+    for (int k = 0; k < descartadas; k++) {
+        idx = avancar_anel(idx, n_rob);
+        ItemROB *item = &fila_reordenacao[idx];
+        if (eh_desvio_condicional(item->op) && !item->pronto)
+            cpu_core.desvios_pendentes--;
+        item->em_uso = false;
+        item->pronto = false;
+    }
+
+    DESENROLAR
+    for (int j = 0; j < n_er; j++) {
+        SlotReserva *er = &estacoes_reserva[j];
+        if (er->ocupado && idade_rob(er->rob_destino, n_rob) > idade)
+            liberar_er(er);
+    }
+
+    // A LSQ está em ordem de programa: basta recuar o tail
+    while (cpu_core.lsq_contagem > 0) {
+        int ultimo = cpu_core.lsq_tail == 0 ? n_lsq - 1 : cpu_core.lsq_tail - 1;
+        if (idade_rob(fila_lsq[ultimo].rob_idx, n_rob) <= idade)
+            break;
+        cpu_core.lsq_tail = ultimo;
+        cpu_core.lsq_contagem--;
+    }
+
+    cpu_core.rob_tail = avancar_anel(rob_idx, n_rob);
+    cpu_core.rob_contagem = idade + 1;
+    estatisticas.instrucoes_descartadas += descartadas;
+}
+
+// Compara o resultado do desvio com a previsão; se errou, descarta o
+// caminho errado e redireciona a busca
+SEMPRE_INLINE void resolver_desvio(int rob_idx, bool tomado, int n_er, int n_rob, int n_lsq) {
+    ItemROB *item = &fila_reordenacao[rob_idx];
+    cpu_core.desvios_pendentes--;
+    if (tomado == item->previsto_tomado)
+        return;
+
+    int descartadas = cpu_core.rob_contagem - idade_rob(rob_idx, n_rob) - 1;
+    descartar_mais_novas(rob_idx, n_er, n_rob, n_lsq);
+
+    item->mal_previsto = true;
+    item->penalidade = (int)(cpu_core.ciclo - item->ciclo_issue);
+    cpu_core.historico = (item->historico << 1) | tomado;
+    cpu_core.pc = tomado ? memoria_instrucoes[item->pc].alvo : item->pc + 1;
+
+    LOG("Misprediction: ROB[%d] (PC=%d), %d instrucao(oes) descartada(s), PC <- %d\n",
+        rob_idx, item->pc, descartadas, cpu_core.pc);
+}
+
+// SW: o dado entra na LSQ e o store fica pronto para o commit
+SEMPRE_INLINE void gravar_dado_store(int i, SlotReserva *er) {
+    fila_lsq[er->lsq_destino].dado = er->val_k;
+    fila_lsq[er->lsq_destino].dado_pronto = true;
+    fila_reordenacao[er->rob_destino].valor = er->val_k;
+    fila_reordenacao[er->rob_destino].pronto = true;
+    LOG("Execute: ER[%d] (SW) -> ROB[%d] (Dado: %d)\n", i, er->rob_destino, er->val_k);
+    liberar_er(er);
+}
+
 // Estágio 2: Execução
-void etapa_execucao() {
-    for (int i = 0; i < QTD_ESTACOES; i++) {
+// Seleção: em cada pool, as ERs prontas mais antigas (pela idade no ROB)
+// ocupam as unidades livres. Em seguida, tudo o que está em execução
+// avança um ciclo; resultados com destino ficam na ER até ganhar o CDB.
+SEMPRE_INLINE void etapa_execucao(int n_er, int n_rob, int n_lsq) {
+    int prontas[QTD_TIPOS_UF] = {0};
+
+    DESENROLAR
+    for (int i = 0; i < n_er; i++) {
         SlotReserva *unidade = &estacoes_reserva[i];
+        if (!unidade->ocupado || unidade->em_execucao)
+            continue;
 
-        if (!unidade->ocupado) continue;
-        
-        if (unidade->tag_j != -1 || unidade->tag_k != -1)
+        // SW com endereço já na LSQ: falta só o dado, que vai direto
+        if (unidade->op == SW && fila_lsq[unidade->lsq_destino].endereco_pronto) {
+            if (unidade->tag_k == -1)
+                gravar_dado_store(i, unidade);
             continue;
+        }
 
-        if (unidade->cycles_left == 0)
-            unidade->cycles_left = latency_for_op(unidade->op);
+        if (pronta_para_uf(unidade))
+            prontas[tipo_uf(unidade->op)]++;
+    }
 
-        unidade->cycles_left--;
+    for (int t = 0; t < QTD_TIPOS_UF; t++) {
+        PoolUF *pool = &pools_uf[t];
+        int despachadas = 0;
+        while (despachadas < prontas[t]) {
+            int u = unidade_livre(pool);
+            if (u < 0)
+                break;
 
-        if (unidade->cycles_left == 0) {
-            int resultado = 0;
-            switch (unidade->op) {
-                case ADD: resultado = unidade->val_j + unidade->val_k; break;
-                case SUB: resultado = unidade->val_j - unidade->val_k; break;
-                case MUL: resultado = unidade->val_j * unidade->val_k; break;
-                case DIV: resultado = (unidade->val_k ? unidade->val_j / unidade->val_k : 0); break;
-                case LI:  resultado = unidade->val_j + unidade->val_k; break;
-                default: break;
+            int escolhida = -1, menor_idade = n_rob;
+            DESENROLAR
+            for (int i = 0; i < n_er; i++) {
+                SlotReserva *er = &estacoes_reserva[i];
+                if (!er->ocupado || er->em_execucao || !pronta_para_uf(er) || tipo_uf(er->op) != (TipoUF)t)
+                    continue;
+                int idade = idade_rob(er->rob_destino, n_rob);
+                if (idade < menor_idade) {
+                    menor_idade = idade;
+                    escolhida = i;
+                }
             }
 
-            fila_reordenacao[unidade->rob_destino].valor = resultado;
-            fila_reordenacao[unidade->rob_destino].pronto = true;
+            SlotReserva *er = &estacoes_reserva[escolhida];
+            er->em_execucao = true;
+            er->cycles_left = latency_for_op(er->op);
+            pool->livre_em[u] = cpu_core.ciclo + (pool->pipelined ? 1 : er->cycles_left);
+            pool->operacoes++;
+            despachadas++;
+            LOG("Dispatch: ER[%d] (%s) -> %s[%d]\n", escolhida, nome_operacao(er->op), pool->nome, u);
+        }
+        pool->esperas += prontas[t] - despachadas;
+    }
 
-            printf("Execute: ER[%d] (%s) -> ROB[%d] (Resultado: %d)\n",
-                   i, nome_operacao(unidade->op), unidade->rob_destino, resultado);
+    DESENROLAR
+    for (int i = 0; i < n_er; i++) {
+        SlotReserva *unidade = &estacoes_reserva[i];
+
+        if (!unidade->ocupado || !unidade->em_execucao || unidade->concluida)
+            continue;
+
+        unidade->cycles_left--;
+
+        if (unidade->cycles_left == 0) {
+            if (unidade->op == LW || unidade->op == SW) {
+                // Só o endereço; o valor do LW chega depois, pela LSQ
+                ItemLSQ *m = &fila_lsq[unidade->lsq_destino];
+                m->endereco = (unsigned)unidade->val_j + (unsigned)m->deslocamento;
+                m->endereco_pronto = true;
+                LOG("Execute: ER[%d] (%s) -> LSQ[%d] (Endereco: %u)\n",
+                    i, nome_operacao(unidade->op), unidade->lsq_destino, m->endereco);
+                if (unidade->op == LW)
+                    liberar_er(unidade);
+                else if (unidade->tag_k == -1)
+                    gravar_dado_store(i, unidade);
+                else
+                    unidade->em_execucao = false; // aguarda o dado
+                continue;
+            }
 
-            unidade->ocupado = false;
-            unidade->tag_j = unidade->tag_k = -1;
-            unidade->val_j = unidade->val_k = 0;
-            unidade->cycles_left = 0;
+            int resultado = calcular_operacao(unidade->op, unidade->val_j, unidade->val_k);
+            if (eh_desvio_condicional(unidade->op)) {
+                // Sem registrador de destino: não precisa do CDB
+                fila_reordenacao[unidade->rob_destino].valor = resultado;
+                fila_reordenacao[unidade->rob_destino].pronto = true;
+                LOG("Execute: ER[%d] (%s) -> ROB[%d] (Resultado: %d)\n",
+                       i, nome_operacao(unidade->op), unidade->rob_destino, resultado);
+                liberar_er(unidade);
+                resolver_desvio(unidade->rob_destino, resultado != 0, n_er, n_rob, n_lsq);
+            } else {
+                unidade->resultado = resultado;
+                unidade->concluida = true;
+                LOG("Execute: ER[%d] (%s) (Resultado: %d)\n",
+                       i, nome_operacao(unidade->op), resultado);
+            }
         } else {
-            printf("Executing: ER[%d] (%s) cycles_left=%d\n",
+            LOG("Executing: ER[%d] (%s) cycles_left=%d\n",
                    i, nome_operacao(unidade->op), unidade->cycles_left);
         }
     }
 }
 
-// Estágio 3/4: Escrita e Commit
-void etapa_finalizacao() {
-    // Broadcast simultâneo
-    for (int i = 0; i < TAM_FILA_ROB; i++) {
-        if (fila_reordenacao[i].em_uso && fila_reordenacao[i].pronto) {
-            for (int j = 0; j < QTD_ESTACOES; j++) {
-                if (estacoes_reserva[j].ocupado) {
-                    if (estacoes_reserva[j].tag_j == i) {
-                        estacoes_reserva[j].val_j = fila_reordenacao[i].valor;
-                        estacoes_reserva[j].tag_j = -1;
-                    }
-                    if (estacoes_reserva[j].tag_k == i) {
-                        estacoes_reserva[j].val_k = fila_reordenacao[i].valor;
-                        estacoes_reserva[j].tag_k = -1;
-                    }
+// Estágio 2b: Memória
+// Loads com endereço conhecido, do mais antigo ao mais novo. Um load só
+// acessa a memória quando todos os stores anteriores têm endereço
+// conhecido (desambiguação conservadora); se algum deles escreve no mesmo
+// endereço, o valor é encaminhado do store mais novo, sem ir à cache.
+SEMPRE_INLINE void etapa_memoria(int n_lsq) {
+    int idx = cpu_core.lsq_head;
+    for (int k = 0; k < cpu_core.lsq_contagem; k++, idx = avancar_anel(idx, n_lsq)) {
+        ItemLSQ *m = &fila_lsq[idx];
+        if (m->op != LW || !m->endereco_pronto || m->dado_pronto)
+            continue;
+
+        if (!m->iniciado) {
+            int fonte = -1;
+            bool bloqueado = false;
+            int s = cpu_core.lsq_head;
+            for (int a = 0; a < k; a++, s = avancar_anel(s, n_lsq)) {
+                if (fila_lsq[s].op != SW)
+                    continue;
+                if (!fila_lsq[s].endereco_pronto) {
+                    bloqueado = true;
+                    break;
                 }
+                if (fila_lsq[s].endereco == m->endereco)
+                    fonte = s;
+            }
+            if (bloqueado) {
+                estatisticas.esperas_desambiguacao++;
+                continue;
+            }
+
+            if (fonte >= 0) {
+                if (!fila_lsq[fonte].dado_pronto)
+                    continue;
+                m->dado = fila_lsq[fonte].dado;
+                m->cycles_left = LATENCIA_ENCAMINHAMENTO;
+                estatisticas.loads_encaminhados++;
+                LOG("Memoria: LSQ[%d] LW MEM[%u] encaminhado de LSQ[%d]\n", idx, m->endereco, fonte);
+            } else {
+                const char *nivel;
+                m->dado = ler_memoria(m->endereco);
+                m->cycles_left = acessar_hierarquia(m->endereco, &nivel);
+                LOG("Memoria: LSQ[%d] LW MEM[%u] (%s, %d ciclos)\n", idx, m->endereco, nivel, m->cycles_left);
+            }
+            m->iniciado = true;
+        }
+
+        if (--m->cycles_left > 0)
+            continue;
+
+        m->dado_pronto = true; // aguarda o CDB
+        LOG("Memoria: LSQ[%d] concluido (Valor: %d)\n", idx, m->dado);
+    }
+}
+
+// Estágio 3: Escrita no CDB
+// Até 'largura_cdb' resultados por ciclo, dos mais antigos aos mais novos,
+// vindos das ERs ou de loads concluídos na LSQ. Os demais esperam.
+SEMPRE_INLINE void difundir(int rob_idx, int valor, int n_er) {
+    fila_reordenacao[rob_idx].valor = valor;
+    fila_reordenacao[rob_idx].pronto = true;
+    DESENROLAR
+    for (int j = 0; j < n_er; j++) {
+        SlotReserva *er = &estacoes_reserva[j];
+        if (!er->ocupado)
+            continue;
+        if (er->tag_j == rob_idx) {
+            er->val_j = valor;
+            er->tag_j = -1;
+        }
+        if (er->tag_k == rob_idx) {
+            er->val_k = valor;
+            er->tag_k = -1;
+        }
+    }
+    LOG("CDB: ROB[%d] <- %d\n", rob_idx, valor);
+}
+
+SEMPRE_INLINE void etapa_cdb(int n_er, int n_rob, int n_lsq) {
+    int candidatos = 0;
+    DESENROLAR
+    for (int i = 0; i < n_er; i++)
+        candidatos += estacoes_reserva[i].ocupado && estacoes_reserva[i].concluida;
+    int idx = cpu_core.lsq_head;
+    for (int k = 0; k < cpu_core.lsq_contagem; k++, idx = avancar_anel(idx, n_lsq))
+        candidatos += fila_lsq[idx].op == LW && fila_lsq[idx].dado_pronto && !fila_lsq[idx].difundido;
+
+    int enviar = candidatos;
+    if (config.largura_cdb > 0 && enviar > config.largura_cdb) {
+        estatisticas.esperas_cdb += enviar - config.largura_cdb;
+        enviar = config.largura_cdb;
+    }
+
+    for (int n = 0; n < enviar; n++) {
+        int er_escolhida = -1, lsq_escolhida = -1, menor_idade = n_rob;
+        DESENROLAR
+        for (int i = 0; i < n_er; i++) {
+            SlotReserva *er = &estacoes_reserva[i];
+            if (er->ocupado && er->concluida && idade_rob(er->rob_destino, n_rob) < menor_idade) {
+                menor_idade = idade_rob(er->rob_destino, n_rob);
+                er_escolhida = i;
             }
         }
+        idx = cpu_core.lsq_head;
+        for (int k = 0; k < cpu_core.lsq_contagem; k++, idx = avancar_anel(idx, n_lsq)) {
+            ItemLSQ *m = &fila_lsq[idx];
+            if (m->op == LW && m->dado_pronto && !m->difundido && idade_rob(m->rob_idx, n_rob) < menor_idade) {
+                menor_idade = idade_rob(m->rob_idx, n_rob);
+                lsq_escolhida = idx;
+            }
+        }
+
+        if (lsq_escolhida >= 0) {
+            fila_lsq[lsq_escolhida].difundido = true;
+            difundir(fila_lsq[lsq_escolhida].rob_idx, fila_lsq[lsq_escolhida].dado, n_er);
+        } else {
+            SlotReserva *er = &estacoes_reserva[er_escolhida];
+            difundir(er->rob_destino, er->resultado, n_er);
+            liberar_er(er);
+        }
     }
+}
 
+// Estágio 4: Commit
+SEMPRE_INLINE void etapa_finalizacao(int n_rob, int n_commit, int n_lsq) {
     // Commit de até N instruções
     int commits = 0;
-    while (commits < N_COMMIT_POR_CICLO) {
+    while (commits < n_commit) {
         int head_idx = cpu_core.rob_head;
-        if (!(fila_reordenacao[head_idx].em_uso && fila_reordenacao[head_idx].pronto))
+        ItemROB *item = &fila_reordenacao[head_idx];
+        if (!(item->em_uso && item->pronto))
             break;
 
-        int dest_reg = fila_reordenacao[head_idx].reg_arq_dest;
-        int val_final = fila_reordenacao[head_idx].valor;
-        registradores_arq.regs[dest_reg] = val_final;
+        if (config.taxa_verificacao > 0)
+            verificar_commit(item, head_idx);
+
+        int dest_reg = item->reg_arq_dest;
+        int val_final = item->valor;
+        if (eh_desvio_condicional(item->op)) {
+            // Treina o preditor apenas com o caminho correto
+            preditor->atualizar(item->pc, item->historico, val_final != 0);
+            estatisticas.desvios++;
+            if (item->mal_previsto) {
+                estatisticas.desvios_mal_previstos++;
+                estatisticas.ciclos_caminho_errado += item->penalidade;
+            }
+            LOG("Commit: %s %s (ROB[%d])\n", nome_operacao(item->op),
+                val_final ? "tomado" : "nao tomado", head_idx);
+        } else if (item->op == SW) {
+            // O store só altera a memória no commit
+            ItemLSQ *m = &fila_lsq[cpu_core.lsq_head];
+            const char *nivel;
+            escrever_memoria(m->endereco, m->dado);
+            acessar_hierarquia(m->endereco, &nivel);
+            estatisticas.stores++;
+            LOG("Commit: MEM[%u] <- %d (ROB[%d])\n", m->endereco, m->dado, head_idx);
+        } else if (dest_reg >= 0) {
+            registradores_arq.regs[dest_reg] = val_final;
+            LOG("Commit: R%d <- %d (ROB[%d])\n", dest_reg, val_final, head_idx);
+        } else {
+            LOG("Commit: %s (ROB[%d])\n", nome_operacao(item->op), head_idx);
+        }
 
-        printf("Commit: R%d <- %d (ROB[%d])\n", dest_reg, val_final, head_idx);
+        if (item->op == LW || item->op == SW) {
+            estatisticas.loads += item->op == LW;
+            cpu_core.lsq_head = avancar_anel(cpu_core.lsq_head, n_lsq);
+            cpu_core.lsq_contagem--;
+        }
 
-        fila_reordenacao[head_idx].em_uso = false;
-        fila_reordenacao[head_idx].pronto = false;
-        cpu_core.rob_head = (cpu_core.rob_head + 1) % TAM_FILA_ROB;
+        item->em_uso = false;
+        item->pronto = false;
+        cpu_core.rob_head = avancar_anel(cpu_core.rob_head, n_rob);
         cpu_core.rob_contagem--;
+        estatisticas.instrucoes++;
         commits++;
     }
 }
 
-// Main
+// Motores
+// Um motor executa um ciclo completo (issue, execução, memória, CDB e
+// commit). As formas mais comuns são instanciadas com limites constantes;
+// as demais usam o motor genérico, que lê os limites de 'config' em tempo
+// de execução.
+// Formato: X(estacoes, rob, issue, commit)
+#define MOTORES_ESPECIALIZADOS(X) \
+    X(4, 4, 1, 1)     /* tomasulo.c */ \
+    X(10, 10, 8, 8)   /* tomasuloCorrigido.c (padrão) */ \
+    X(4, 4, 2, 2)     \
+    X(8, 8, 2, 2)     \
+    X(16, 16, 4, 4)   \
+    X(32, 32, 4, 4)   \
+    X(32, 64, 8, 8)   \
+    X(64, 128, 8, 8)  \
+    X(64, 256, 8, 8)
 
-int main() {
-    FILE *fp = fopen("simulacao.txt", "r");
-    if (fp == NULL) {
-        perror("Erro ao abrir 'simulacao.txt'");
-        return 1;
+typedef void (*FuncaoCiclo)(int instr_count);
+
+typedef struct {
+    int qtd_estacoes;
+    int tam_rob;
+    int n_issue;
+    int n_commit;
+    FuncaoCiclo ciclo;
+} Motor;
+
+#define DEFINIR_MOTOR(ER, ROB, ISSUE, COMMIT) \
+    static void ciclo_##ER##_##ROB##_##ISSUE##_##COMMIT(int instr_count) { \
+        etapa_despacho(instr_count, ER, ROB, ISSUE, TAM_FILA_LSQ); \
+        etapa_execucao(ER, ROB, TAM_FILA_LSQ); \
+        etapa_memoria(TAM_FILA_LSQ); \
+        etapa_cdb(ER, ROB, TAM_FILA_LSQ); \
+        etapa_finalizacao(ROB, COMMIT, TAM_FILA_LSQ); \
+    }
+
+MOTORES_ESPECIALIZADOS(DEFINIR_MOTOR)
+
+static void ciclo_generico(int instr_count) {
+    etapa_despacho(instr_count, config.qtd_estacoes, config.tam_rob, config.n_issue, config.tam_lsq);
+    etapa_execucao(config.qtd_estacoes, config.tam_rob, config.tam_lsq);
+    etapa_memoria(config.tam_lsq);
+    etapa_cdb(config.qtd_estacoes, config.tam_rob, config.tam_lsq);
+    etapa_finalizacao(config.tam_rob, config.n_commit, config.tam_lsq);
+}
+
+#define ENTRADA_MOTOR(ER, ROB, ISSUE, COMMIT) \
+    {ER, ROB, ISSUE, COMMIT, ciclo_##ER##_##ROB##_##ISSUE##_##COMMIT},
+
+static const Motor motores[] = {
+    MOTORES_ESPECIALIZADOS(ENTRADA_MOTOR)
+};
+
+// Escolhe o motor especializado que corresponde à configuração, se houver
+FuncaoCiclo selecionar_motor() {
+    for (size_t i = 0; i < sizeof(motores) / sizeof(motores[0]); i++) {
+        const Motor *m = &motores[i];
+        if (m->qtd_estacoes == config.qtd_estacoes && m->tam_rob == config.tam_rob &&
+            m->n_issue == config.n_issue && m->n_commit == config.n_commit &&
+            config.tam_lsq == TAM_FILA_LSQ)
+            return m->ciclo;
     }
+    return ciclo_generico;
+}
+
+// Montador
+// Lê o arquivo inteiro para a memória e o decodifica em uma única passada,
+// sem alocações por linha: os tokens apontam direto para o texto. Arquivos
+// grandes são divididos em blocos (sempre em fim de linha) montados em
+// paralelo; ao final os blocos são concatenados em 'memoria_instrucoes'.
+//
+// Sintaxe (uma instrução por linha):
+//   [rotulo:] MNEMONICO operandos   # comentário (também com ';')
+// Desvios citam rótulos, que podem ser definidos depois do uso: cada uso
+// vira uma pendência resolvida após a concatenação dos blocos.
+// A diretiva '.word endereco, valor' inicializa a memória de dados.
+
+typedef enum {
+    TOK_FIM_LINHA, TOK_NOME, TOK_REG, TOK_NUM,
+    TOK_VIRGULA, TOK_ABRE_PAR, TOK_FECHA_PAR, TOK_DOIS_PONTOS, TOK_INVALIDO
+} TipoToken;
+
+typedef struct {
+    TipoToken tipo;
+    const char *ini;
+    int len;
+    long long valor; // registrador ou número (64 bits também onde long tem 32)
+} Token;
+
+typedef struct {
+    const char *p;     // posição atual
+    const char *fim;   // fim do bloco
+    const char *linha; // início da linha atual
+} Lexer;
+
+// Rótulo definido no programa (o nome aponta para o texto do arquivo)
+typedef struct {
+    const char *nome;
+    int len;
+    int instr;                // índice da instrução rotulada
+    long linha;
+    const char *inicio_linha;
+} Rotulo;
 
-    char line[100];
-    int instr_count = 0;
-    while (fgets(line, sizeof(line), fp) && instr_count < MAX_INSTR_MEM) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\r') line[len-1] = '\0';
+// Uso de rótulo a resolver (alvo de desvio)
+typedef struct {
+    int instr;
+    const char *nome;
+    int len;
+    long linha;
+    const char *inicio_linha;
+} Pendencia;
+
+// Valor inicial da memória de dados (.word)
+typedef struct {
+    unsigned endereco;
+    int valor;
+} DadoInicial;
 
-        char mnemonic[10];
-        int rd = -1, rs = -1, rt = -1, imm = 0;
+typedef struct {
+    long linha; // relativa ao início do bloco até a concatenação
+    int coluna;
+    const char *inicio_linha;
+    char msg[96];
+} Diagnostico;
+
+// Estado de montagem de um bloco do arquivo
+typedef struct {
+    const char *ini, *fim;
+    Operacao *instrs;
+    int n_instrs, cap_instrs;
+    Rotulo *rotulos;
+    int n_rotulos, cap_rotulos;
+    Pendencia *pendencias;
+    int n_pendencias, cap_pendencias;
+    DadoInicial *dados;
+    int n_dados, cap_dados;
+    long n_linhas;
+    Diagnostico diag[MAX_DIAGNOSTICOS];
+    int n_diag;
+    long n_erros;
+    bool sem_memoria;
+} BlocoMontagem;
 
-        if (sscanf(line, " %15s", mnemonic) != 1) continue;
+// Tabela de rótulos do programa (endereçamento aberto)
+typedef struct {
+    Rotulo *itens;
+    int *slots; // índice em 'itens', ou -1
+    int n_itens, n_slots;
+} TabelaRotulos;
+
+TabelaRotulos tabela_rotulos = {NULL, NULL, 0, 0};
+
+static bool eh_inicio_nome(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '.';
+}
+
+static bool eh_digito(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool eh_parte_nome(char c) {
+    return eh_inicio_nome(c) || eh_digito(c);
+}
 
-        Operacao instr;
-        instr.op = decodificar_mnemonico(mnemonic);
+static inline Token proximo_token(Lexer *lx) {
+    Token t = {TOK_FIM_LINHA, lx->p, 0, 0};
+    const char *p = lx->p;
 
-        if (instr.op == HALT) {
-            instr.rd = instr.rs1 = instr.rs2 = 0;
-            memoria_instrucoes[instr_count++] = instr;
+    while (p < lx->fim && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    t.ini = p;
+
+    if (p >= lx->fim || *p == '\n') {
+        lx->p = p;
+        return t;
+    }
+    if (*p == '#' || *p == ';') {
+        while (p < lx->fim && *p != '\n')
+            p++;
+        lx->p = p;
+        return t;
+    }
+
+    switch (*p) {
+        case ',': t.tipo = TOK_VIRGULA; p++; break;
+        case '(': t.tipo = TOK_ABRE_PAR; p++; break;
+        case ')': t.tipo = TOK_FECHA_PAR; p++; break;
+        case ':': t.tipo = TOK_DOIS_PONTOS; p++; break;
+        default:
+            if (eh_inicio_nome(*p)) {
+                const char *q = p + 1;
+                while (q < lx->fim && eh_parte_nome(*q))
+                    q++;
+                t.tipo = TOK_NOME;
+                // Registrador: R seguido apenas de dígitos
+                if ((*p == 'R' || *p == 'r') && q - p > 1 && q - p <= 6) {
+                    long r = 0;
+                    const char *d = p + 1;
+                    while (d < q && eh_digito(*d))
+                        r = r * 10 + (*d++ - '0');
+                    if (d == q) {
+                        t.tipo = TOK_REG;
+                        t.valor = r;
+                    }
+                }
+                p = q;
+            } else if (eh_digito(*p) || ((*p == '-' || *p == '+') && p + 1 < lx->fim && eh_digito(p[1]))) {
+                bool negativo = (*p == '-');
+                long long v = 0;
+                if (*p == '-' || *p == '+')
+                    p++;
+                while (p < lx->fim && eh_digito(*p)) {
+                    if (v <= 2147483648LL) // satura: o excesso vira erro de intervalo
+                        v = v * 10 + (*p - '0');
+                    p++;
+                }
+                t.tipo = TOK_NUM;
+                t.valor = negativo ? -v : v;
+                if (p < lx->fim && eh_parte_nome(*p))
+                    t.tipo = TOK_INVALIDO;
+            } else {
+                t.tipo = TOK_INVALIDO;
+                p++;
+            }
+    }
+    t.len = (int)(p - t.ini);
+    lx->p = p;
+    return t;
+}
+
+// Empacota até 4 caracteres do mnemônico, já em maiúsculas, em um inteiro
+#define CHAVE(a, b, c, d) (((unsigned)(a) << 24) | ((unsigned)(b) << 16) | ((unsigned)(c) << 8) | (unsigned)(d))
+
+static unsigned chave_mnemonico(const Token *t) {
+    if (t->len > 4)
+        return 0;
+    unsigned k = 0;
+    for (int i = 0; i < 4; i++)
+        k = (k << 8) | (i < t->len ? (unsigned char)(t->ini[i] & ~0x20) : 0u);
+    return k;
+}
+
+// Retorna -1 se o mnemônico não existir
+int decodificar_mnemonico(const Token *t) {
+    switch (chave_mnemonico(t)) {
+        case CHAVE('A', 'D', 'D', 0):   return ADD;
+        case CHAVE('M', 'U', 'L', 0):   return MUL;
+        case CHAVE('S', 'U', 'B', 0):   return SUB;
+        case CHAVE('D', 'I', 'V', 0):   return DIV;
+        case CHAVE('L', 'I', 0, 0):     return LI;
+        case CHAVE('L', 'W', 0, 0):     return LW;
+        case CHAVE('S', 'W', 0, 0):     return SW;
+        case CHAVE('H', 'A', 'L', 'T'): return HALT;
+        case CHAVE('B', 'E', 'Q', 0):   return BEQ;
+        case CHAVE('B', 'N', 'E', 0):   return BNE;
+        case CHAVE('B', 'L', 'T', 0):   return BLT;
+        case CHAVE('J', 0, 0, 0):       return JMP;
+        default:                        return -1;
+    }
+}
+
+static void registrar_erro(BlocoMontagem *b, const Lexer *lx, long linha, const char *pos, const char *fmt, ...) {
+    b->n_erros++;
+    if (b->n_diag >= MAX_DIAGNOSTICOS)
+        return;
+    Diagnostico *d = &b->diag[b->n_diag++];
+    d->linha = linha;
+    d->coluna = (int)(pos - lx->linha) + 1;
+    d->inicio_linha = lx->linha;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(d->msg, sizeof(d->msg), fmt, args);
+    va_end(args);
+}
+
+static const char *descrever_token(const Token *t) {
+    switch (t->tipo) {
+        case TOK_FIM_LINHA:   return "fim da linha";
+        case TOK_NOME:        return "nome";
+        case TOK_REG:         return "registrador";
+        case TOK_NUM:         return "numero";
+        case TOK_VIRGULA:     return "','";
+        case TOK_ABRE_PAR:    return "'('";
+        case TOK_FECHA_PAR:   return "')'";
+        case TOK_DOIS_PONTOS: return "':'";
+        default:              return "caractere invalido";
+    }
+}
+
+// Consome um token do tipo esperado; em caso de erro registra o diagnóstico
+static inline bool esperar(BlocoMontagem *b, Lexer *lx, long linha, TipoToken tipo, const char *o_que, Token *saida) {
+    Token t = proximo_token(lx);
+    if (t.tipo != tipo) {
+        registrar_erro(b, lx, linha, t.ini, "esperado %s, encontrado %s", o_que, descrever_token(&t));
+        return false;
+    }
+    if (tipo == TOK_REG && (t.valor < 0 || t.valor >= QTD_REGISTRADORES)) {
+        registrar_erro(b, lx, linha, t.ini, "registrador R%lld fora do intervalo (R0-R%d)",
+                       t.valor, QTD_REGISTRADORES - 1);
+        return false;
+    }
+    if (tipo == TOK_NUM && (t.valor < -2147483647LL - 1 || t.valor > 2147483647LL)) {
+        registrar_erro(b, lx, linha, t.ini, "imediato fora do intervalo de 32 bits");
+        return false;
+    }
+    if (saida) *saida = t;
+    return true;
+}
+
+static bool adicionar_rotulo(BlocoMontagem *b, const Lexer *lx, long linha, const Token *t) {
+    if (b->n_rotulos == b->cap_rotulos) {
+        int cap = b->cap_rotulos ? b->cap_rotulos * 2 : 16;
+        Rotulo *novo = realloc(b->rotulos, (size_t)cap * sizeof(Rotulo));
+        if (novo == NULL) return false;
+        b->rotulos = novo;
+        b->cap_rotulos = cap;
+    }
+    Rotulo *r = &b->rotulos[b->n_rotulos++];
+    r->nome = t->ini;
+    r->len = t->len;
+    r->instr = b->n_instrs;
+    r->linha = linha;
+    r->inicio_linha = lx->linha;
+    return true;
+}
+
+static bool adicionar_pendencia(BlocoMontagem *b, const Lexer *lx, long linha, const Token *t) {
+    if (b->n_pendencias == b->cap_pendencias) {
+        int cap = b->cap_pendencias ? b->cap_pendencias * 2 : 16;
+        Pendencia *novo = realloc(b->pendencias, (size_t)cap * sizeof(Pendencia));
+        if (novo == NULL) return false;
+        b->pendencias = novo;
+        b->cap_pendencias = cap;
+    }
+    Pendencia *p = &b->pendencias[b->n_pendencias++];
+    p->instr = b->n_instrs;
+    p->nome = t->ini;
+    p->len = t->len;
+    p->linha = linha;
+    p->inicio_linha = lx->linha;
+    return true;
+}
+
+static bool adicionar_dado(BlocoMontagem *b, unsigned endereco, int valor) {
+    if (b->n_dados == b->cap_dados) {
+        int cap = b->cap_dados ? b->cap_dados * 2 : 16;
+        DadoInicial *novo = realloc(b->dados, (size_t)cap * sizeof(DadoInicial));
+        if (novo == NULL) return false;
+        b->dados = novo;
+        b->cap_dados = cap;
+    }
+    b->dados[b->n_dados].endereco = endereco;
+    b->dados[b->n_dados].valor = valor;
+    b->n_dados++;
+    return true;
+}
+
+static bool adicionar_instrucao(BlocoMontagem *b, Operacao instr) {
+    if (b->n_instrs == b->cap_instrs) {
+        int cap = b->cap_instrs ? b->cap_instrs * 2 : 64;
+        Operacao *novo = realloc(b->instrs, (size_t)cap * sizeof(Operacao));
+        if (novo == NULL) return false;
+        b->instrs = novo;
+        b->cap_instrs = cap;
+    }
+    b->instrs[b->n_instrs++] = instr;
+    return true;
+}
+
+// Decodifica uma linha. Retorna false se a linha tiver erro.
+static bool montar_linha(BlocoMontagem *b, Lexer *lx, long linha) {
+    Token t = proximo_token(lx);
+
+    // Rótulos no início da linha
+    while (t.tipo == TOK_NOME) {
+        Lexer depois = *lx;
+        if (proximo_token(&depois).tipo != TOK_DOIS_PONTOS)
             break;
-        } else if (instr.op == LI) {
-            sscanf(line, "%*s R%d , R%d ( %d )", &rd, &rs, &imm);
-            instr.rd = rd; instr.rs1 = rs; instr.rs2 = imm;
-        } else {
-            sscanf(line, "%*s R%d , R%d , R%d", &rd, &rs, &rt);
-            instr.rd = rd; instr.rs1 = rs; instr.rs2 = rt;
+        *lx = depois;
+        if (!adicionar_rotulo(b, lx, linha, &t)) {
+            b->sem_memoria = true;
+            return false;
         }
+        t = proximo_token(lx);
+    }
+
+    if (t.tipo == TOK_FIM_LINHA)
+        return true;
+    if (t.tipo != TOK_NOME) {
+        registrar_erro(b, lx, linha, t.ini, "esperado mnemonico, encontrado %s", descrever_token(&t));
+        return false;
+    }
+
+    if (t.len == 5 && memcmp(t.ini, ".word", 5) == 0) {
+        Token end, valor;
+        if (!esperar(b, lx, linha, TOK_NUM, "endereco", &end) ||
+            !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+            !esperar(b, lx, linha, TOK_NUM, "valor", &valor) ||
+            !esperar(b, lx, linha, TOK_FIM_LINHA, "fim da linha", NULL))
+            return false;
+        if (!adicionar_dado(b, (unsigned)end.valor, (int)valor.valor)) {
+            b->sem_memoria = true;
+            return false;
+        }
+        return true;
+    }
+
+    int op = decodificar_mnemonico(&t);
+    if (op < 0) {
+        registrar_erro(b, lx, linha, t.ini, "instrucao desconhecida '%.*s'", t.len, t.ini);
+        return false;
+    }
+
+    Operacao instr = {op, 0, 0, 0, -1, 0};
+    Token rd, rs, rt, imm, alvo = {TOK_FIM_LINHA, NULL, 0, 0};
+    switch (op) {
+        case HALT:
+            break;
+        case JMP: // J rotulo
+            if (!esperar(b, lx, linha, TOK_NOME, "rotulo", &alvo))
+                return false;
+            break;
+        case BEQ: // Bxx Rs, Rt, rotulo
+        case BNE:
+        case BLT:
+            if (!esperar(b, lx, linha, TOK_REG, "registrador", &rs) ||
+                !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+                !esperar(b, lx, linha, TOK_REG, "registrador", &rt) ||
+                !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+                !esperar(b, lx, linha, TOK_NOME, "rotulo", &alvo))
+                return false;
+            instr.rs1 = (int)rs.valor; instr.rs2 = (int)rt.valor;
+            break;
+        case LI: // LI Rd, imm
+            if (!esperar(b, lx, linha, TOK_REG, "registrador de destino", &rd) ||
+                !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+                !esperar(b, lx, linha, TOK_NUM, "imediato", &imm))
+                return false;
+            instr.rd = (int)rd.valor; instr.imm = (int)imm.valor;
+            break;
+        case LW: // LW Rd, Rs (imm)
+        case SW: // SW Rt, Rs (imm)
+            if (!esperar(b, lx, linha, TOK_REG, op == LW ? "registrador de destino" : "registrador", &rd) ||
+                !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+                !esperar(b, lx, linha, TOK_REG, "registrador base", &rs) ||
+                !esperar(b, lx, linha, TOK_ABRE_PAR, "'('", NULL) ||
+                !esperar(b, lx, linha, TOK_NUM, "deslocamento", &imm) ||
+                !esperar(b, lx, linha, TOK_FECHA_PAR, "')'", NULL))
+                return false;
+            instr.rs1 = (int)rs.valor; instr.imm = (int)imm.valor;
+            if (op == LW)
+                instr.rd = (int)rd.valor;
+            else
+                instr.rs2 = (int)rd.valor;
+            break;
+        default: // OP Rd, Rs, Rt
+            if (!esperar(b, lx, linha, TOK_REG, "registrador de destino", &rd) ||
+                !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+                !esperar(b, lx, linha, TOK_REG, "registrador", &rs) ||
+                !esperar(b, lx, linha, TOK_VIRGULA, "','", NULL) ||
+                !esperar(b, lx, linha, TOK_REG, "registrador", &rt))
+                return false;
+            instr.rd = (int)rd.valor; instr.rs1 = (int)rs.valor; instr.rs2 = (int)rt.valor;
+            break;
+    }
+
+    if (!esperar(b, lx, linha, TOK_FIM_LINHA, "fim da linha", NULL))
+        return false;
 
-        memoria_instrucoes[instr_count++] = instr;
+    if ((op == JMP || eh_desvio_condicional(op)) && !adicionar_pendencia(b, lx, linha, &alvo)) {
+        b->sem_memoria = true;
+        return false;
+    }
+    if (!adicionar_instrucao(b, instr)) {
+        b->sem_memoria = true;
+        return false;
+    }
+    return true;
+}
+
+static void montar_bloco(BlocoMontagem *b) {
+    Lexer lx = {b->ini, b->fim, b->ini};
+    long linha = 0;
+
+    // Reserva uma instrução por linha para não realocar durante a montagem
+    long long n_linhas = 1;
+    for (const char *p = b->ini; (p = memchr(p, '\n', (size_t)(b->fim - p))) != NULL; p++)
+        n_linhas++;
+    if (n_linhas <= 2147483647LL) {
+        b->instrs = malloc((size_t)n_linhas * sizeof(Operacao));
+        if (b->instrs != NULL)
+            b->cap_instrs = (int)n_linhas;
+    }
+
+    while (lx.p < lx.fim && !b->sem_memoria) {
+        lx.linha = lx.p;
+        linha++;
+        montar_linha(b, &lx, linha);
+
+        // Recuperação: descarta o restante da linha (após erro ou comentário)
+        const char *nl = memchr(lx.p, '\n', (size_t)(lx.fim - lx.p));
+        lx.p = nl ? nl + 1 : lx.fim;
+    }
+    b->n_linhas = linha;
+}
+
+static void *montar_bloco_thread(void *arg) {
+    montar_bloco((BlocoMontagem *)arg);
+    return NULL;
+}
+
+static void imprimir_diagnostico(const char *arquivo, const char *fim_texto, long linha, int coluna,
+                                 const char *inicio_linha, const char *msg) {
+    const char *fim_linha = inicio_linha;
+    while (fim_linha < fim_texto && *fim_linha != '\n' && *fim_linha != '\r')
+        fim_linha++;
+    fprintf(stderr, "%s:%ld:%d: erro: %s\n", arquivo, linha, coluna, msg);
+    fprintf(stderr, "    %.*s\n", (int)(fim_linha - inicio_linha), inicio_linha);
+    fprintf(stderr, "    %*s^\n", coluna - 1, "");
+}
+
+static unsigned hash_nome(const char *nome, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)nome[i]) * 16777619u;
+    return h;
+}
+
+const Rotulo *buscar_rotulo(const char *nome, int len) {
+    if (tabela_rotulos.n_slots == 0)
+        return NULL;
+    unsigned mascara = (unsigned)tabela_rotulos.n_slots - 1;
+    for (unsigned s = hash_nome(nome, len) & mascara;; s = (s + 1) & mascara) {
+        int i = tabela_rotulos.slots[s];
+        if (i < 0)
+            return NULL;
+        const Rotulo *r = &tabela_rotulos.itens[i];
+        if (r->len == len && memcmp(r->nome, nome, (size_t)len) == 0)
+            return r;
+    }
+}
+
+// Insere o rótulo; retorna o índice de um rótulo anterior com o mesmo nome, se houver
+static int inserir_rotulo(int idx) {
+    Rotulo *novo = &tabela_rotulos.itens[idx];
+    unsigned mascara = (unsigned)tabela_rotulos.n_slots - 1;
+    unsigned s = hash_nome(novo->nome, novo->len) & mascara;
+    for (;; s = (s + 1) & mascara) {
+        int i = tabela_rotulos.slots[s];
+        if (i < 0)
+            break;
+        Rotulo *r = &tabela_rotulos.itens[i];
+        if (r->len == novo->len && memcmp(r->nome, novo->nome, (size_t)novo->len) == 0)
+            return i;
+    }
+    tabela_rotulos.slots[s] = idx;
+    return -1;
+}
+
+static char *ler_arquivo(const char *arquivo, size_t *tam) {
+    FILE *fp = fopen(arquivo, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Erro ao abrir '%s': ", arquivo);
+        perror(NULL);
+        return NULL;
+    }
+
+    // Tamanho conhecido: uma única leitura. Caso contrário (pipe), cresce aos poucos.
+    size_t cap = 1 << 16, n = 0;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long fim = ftell(fp);
+        if (fim > 0)
+            cap = (size_t)fim + 1;
+        rewind(fp);
+    }
+    char *texto = malloc(cap);
+    while (texto != NULL) {
+        n += fread(texto + n, 1, cap - n, fp);
+        if (n < cap)
+            break;
+        cap *= 2;
+        char *novo = realloc(texto, cap);
+        if (novo == NULL) free(texto);
+        texto = novo;
+    }
+    if (texto == NULL)
+        fprintf(stderr, "Erro: memoria insuficiente para ler '%s'\n", arquivo);
+    else if (ferror(fp)) {
+        fprintf(stderr, "Erro ao ler '%s'\n", arquivo);
+        free(texto);
+        texto = NULL;
     }
     fclose(fp);
+    *tam = n;
+    return texto;
+}
+
+int threads_disponiveis() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return n > MAX_THREADS_MONTADOR ? MAX_THREADS_MONTADOR : (int)n;
+#endif
+    return 1;
+}
+
+// Monta o arquivo em 'memoria_instrucoes'. Retorna a quantidade de
+// instruções, ou -1 em caso de erro. O texto do arquivo permanece em
+// memória porque os rótulos apontam para ele.
+int montar_programa(const char *arquivo, int n_threads) {
+    size_t tam;
+    char *texto = ler_arquivo(arquivo, &tam);
+    if (texto == NULL)
+        return -1;
+    const char *fim = texto + tam;
+
+    if (n_threads <= 0)
+        n_threads = threads_disponiveis();
+    if (tam < TAM_MIN_MONTAGEM_PARALELA)
+        n_threads = 1;
+
+    // Divide o texto em blocos terminados em fim de linha
+    BlocoMontagem *blocos = calloc((size_t)n_threads, sizeof(BlocoMontagem));
+    if (blocos == NULL) {
+        fprintf(stderr, "Erro: memoria insuficiente\n");
+        free(texto);
+        return -1;
+    }
+    const char *ini = texto;
+    int n_blocos = 0;
+    for (int k = 1; k <= n_threads && ini < fim; k++) {
+        const char *corte = (k == n_threads) ? fim : texto + tam / (size_t)n_threads * (size_t)k;
+        if (corte < ini) corte = ini;
+        const char *nl = memchr(corte, '\n', (size_t)(fim - corte));
+        corte = nl ? nl + 1 : fim;
+        blocos[n_blocos].ini = ini;
+        blocos[n_blocos].fim = corte;
+        n_blocos++;
+        ini = corte;
+    }
+
+    if (n_blocos <= 1) {
+        if (n_blocos == 1)
+            montar_bloco(&blocos[0]);
+    } else {
+        pthread_t threads[MAX_THREADS_MONTADOR];
+        int criadas = 0;
+        for (; criadas < n_blocos; criadas++) {
+            if (pthread_create(&threads[criadas], NULL, montar_bloco_thread, &blocos[criadas]) != 0)
+                break;
+        }
+        for (int k = criadas; k < n_blocos; k++)
+            montar_bloco(&blocos[k]);
+        for (int k = 0; k < criadas; k++)
+            pthread_join(threads[k], NULL);
+    }
+
+    // Concatena os blocos e ajusta linhas e índices para valores globais
+    long long total_instrs = 0;
+    long total_erros = 0, linha_base = 0, exibidos = 0;
+    int total_rotulos = 0;
+    bool sem_memoria = false;
+    for (int k = 0; k < n_blocos; k++) {
+        BlocoMontagem *b = &blocos[k];
+        for (int d = 0; d < b->n_diag; d++) {
+            if (exibidos++ < MAX_DIAGNOSTICOS)
+                imprimir_diagnostico(arquivo, fim, linha_base + b->diag[d].linha, b->diag[d].coluna,
+                                     b->diag[d].inicio_linha, b->diag[d].msg);
+        }
+        for (int r = 0; r < b->n_rotulos; r++) {
+            b->rotulos[r].instr += (int)total_instrs;
+            b->rotulos[r].linha += linha_base;
+        }
+        for (int p = 0; p < b->n_pendencias; p++)
+            b->pendencias[p].linha += linha_base;
+        total_erros += b->n_erros;
+        total_instrs += b->n_instrs;
+        total_rotulos += b->n_rotulos;
+        linha_base += b->n_linhas;
+        sem_memoria |= b->sem_memoria;
+    }
+
+    if (total_instrs > 2147483647LL)
+        sem_memoria = true;
+
+    if (sem_memoria)
+        memoria_instrucoes = NULL;
+    else if (n_blocos == 1 && blocos[0].instrs != NULL) {
+        memoria_instrucoes = blocos[0].instrs; // bloco único: aproveita o vetor
+        blocos[0].instrs = NULL;
+    } else
+        memoria_instrucoes = malloc((size_t)(total_instrs ? total_instrs : 1) * sizeof(Operacao));
+    int n_slots = 16;
+    while (n_slots < 2 * total_rotulos)
+        n_slots *= 2;
+    tabela_rotulos.itens = malloc((size_t)(total_rotulos ? total_rotulos : 1) * sizeof(Rotulo));
+    tabela_rotulos.slots = malloc((size_t)n_slots * sizeof(int));
+    tabela_rotulos.n_slots = n_slots;
+
+    if (memoria_instrucoes == NULL || tabela_rotulos.itens == NULL || tabela_rotulos.slots == NULL) {
+        fprintf(stderr, "Erro: memoria insuficiente para montar '%s'\n", arquivo);
+        total_erros++;
+    } else {
+        memset(tabela_rotulos.slots, -1, (size_t)n_slots * sizeof(int));
+        long pos = 0;
+        for (int k = 0; k < n_blocos; k++) {
+            BlocoMontagem *b = &blocos[k];
+            if (b->instrs != NULL && b->n_instrs > 0)
+                memcpy(memoria_instrucoes + pos, b->instrs, (size_t)b->n_instrs * sizeof(Operacao));
+            pos += b->n_instrs;
+
+            for (int r = 0; r < b->n_rotulos; r++) {
+                int idx = tabela_rotulos.n_itens++;
+                tabela_rotulos.itens[idx] = b->rotulos[r];
+                int anterior = inserir_rotulo(idx);
+                if (anterior >= 0) {
+                    Rotulo *novo = &tabela_rotulos.itens[idx];
+                    char msg[96];
+                    snprintf(msg, sizeof(msg), "rotulo '%.*s' ja definido na linha %ld",
+                             novo->len, novo->nome, tabela_rotulos.itens[anterior].linha);
+                    if (exibidos++ < MAX_DIAGNOSTICOS)
+                        imprimir_diagnostico(arquivo, fim, novo->linha,
+                                             (int)(novo->nome - novo->inicio_linha) + 1,
+                                             novo->inicio_linha, msg);
+                    total_erros++;
+                }
+            }
+        }
+
+        // Resolve os alvos dos desvios e inicializa a memória de dados
+        long base = 0;
+        for (int k = 0; k < n_blocos; k++) {
+            BlocoMontagem *b = &blocos[k];
+            for (int d = 0; d < b->n_dados; d++)
+                escrever_memoria(b->dados[d].endereco, b->dados[d].valor);
+            for (int p = 0; p < b->n_pendencias; p++) {
+                Pendencia *pend = &b->pendencias[p];
+                const Rotulo *r = buscar_rotulo(pend->nome, pend->len);
+                if (r != NULL) {
+                    memoria_instrucoes[base + pend->instr].alvo = r->instr;
+                    continue;
+                }
+                char msg[96];
+                snprintf(msg, sizeof(msg), "rotulo '%.*s' nao definido", pend->len, pend->nome);
+                if (exibidos++ < MAX_DIAGNOSTICOS)
+                    imprimir_diagnostico(arquivo, fim, pend->linha,
+                                         (int)(pend->nome - pend->inicio_linha) + 1,
+                                         pend->inicio_linha, msg);
+                total_erros++;
+            }
+            base += b->n_instrs;
+        }
+    }
 
-    bool halt_detectado = false;
+    for (int k = 0; k < n_blocos; k++) {
+        free(blocos[k].instrs);
+        free(blocos[k].rotulos);
+        free(blocos[k].pendencias);
+        free(blocos[k].dados);
+    }
+    free(blocos);
+
+    // Os rótulos apontam para o texto; nenhum dos dois é usado após a montagem
+    free(tabela_rotulos.itens);
+    free(tabela_rotulos.slots);
+    tabela_rotulos = (TabelaRotulos){NULL, NULL, 0, 0};
+    free(texto);
+
+    if (total_erros > MAX_DIAGNOSTICOS)
+        fprintf(stderr, "... mais %ld erro(s) omitido(s)\n", total_erros - MAX_DIAGNOSTICOS);
+    if (total_erros > 0) {
+        fprintf(stderr, "%s: %ld erro(s); simulacao nao executada.\n", arquivo, total_erros);
+        free(memoria_instrucoes);
+        memoria_instrucoes = NULL;
+        return -1;
+    }
+
+    LOG("Programa: %lld instrucoes, %d rotulos, %ld linhas (%d bloco(s))\n",
+        total_instrs, total_rotulos, linha_base, n_blocos);
+    return (int)total_instrs;
+}
+
+// Linha de Comando
+
+void mostrar_uso(const char *prog) {
+    fprintf(stderr,
+        "Uso: %s [opcoes] [arquivo]\n"
+        "  -e N  estacoes de reserva (padrao %d, max %d)\n"
+        "  -r N  entradas do ROB (padrao %d, max %d)\n"
+        "  -i N  instrucoes emitidas por ciclo (padrao %d)\n"
+        "  -c N  commits por ciclo (padrao %d)\n"
+        "  -m N  limite de ciclos, 0 = sem limite (padrao %d)\n"
+        "  -t N  threads do montador, 0 = automatico (padrao 0)\n"
+        "  -p P  preditor de desvios: estatico, bimodal ou gshare (padrao bimodal)\n"
+        "  -b N  bits de indice da tabela do preditor (padrao %d, max %d)\n"
+        "  -s N  desvios nao resolvidos em voo, 0 = sem limite (padrao 0)\n"
+        "  -l N  entradas da fila de loads/stores (padrao %d, max %d)\n"
+        "  -L1 C,V,P,T  cache L1: conjuntos, vias, palavras por linha, latencia\n"
+        "               (padrao %d,%d,%d,%d; C = 0 desativa)\n"
+        "  -L2 C,V,P,T  cache L2 (padrao %d,%d,%d,%d)\n"
+        "  -lm N latencia da memoria principal (padrao %d)\n"
+        "  -k N  resultados no CDB por ciclo, 0 = sem limite (padrao %d)\n"
+        "  -v N  %% das janelas de %d commits conferidas pelo verificador (padrao 0)\n"
+        "  -fu U=N[p|n]  pool de unidades funcionais (alu, mul, div, mem):\n"
+        "               quantidade e pipelined (p) ou nao (n)\n"
+        "               (padrao alu=%dp, mul=%dp, div=%dn, mem=%dp)\n"
+        "  -o A  grava metricas por intervalo no arquivo A (ver leitor_metricas.c)\n"
+        "  -n N  ciclos por intervalo das metricas (padrao %d)\n"
+        "  -q    modo silencioso (sem rastro por ciclo)\n",
+        prog, QTD_ESTACOES, MAX_ESTACOES, TAM_FILA_ROB, MAX_FILA_ROB,
+        N_ISSUE_POR_CICLO, N_COMMIT_POR_CICLO, MAX_CICLOS, BITS_PREDITOR, MAX_BITS_PREDITOR,
+        TAM_FILA_LSQ, MAX_FILA_LSQ, L1_CONJUNTOS, L1_VIAS, L1_LINHA, L1_LATENCIA,
+        L2_CONJUNTOS, L2_VIAS, L2_LINHA, L2_LATENCIA, LATENCIA_MEMORIA,
+        LARGURA_CDB, JANELA_VERIFICACAO, QTD_UF_ALU, QTD_UF_MUL, QTD_UF_DIV, QTD_UF_MEM,
+        INTERVALO_METRICAS);
+}
+
+bool ler_inteiro(const char *texto, int min, int max, int *saida) {
+    char *fim;
+    long long v = strtoll(texto, &fim, 10);
+    if (*texto == '\0' || *fim != '\0' || v < min || v > max)
+        return false;
+    *saida = (int)v;
+    return true;
+}
+
+static bool potencia_de_dois(int v) {
+    return v > 0 && (v & (v - 1)) == 0;
+}
+
+// Lê "conjuntos,vias,linha,latencia"
+bool ler_geometria_cache(const char *texto, Cache *c) {
+    int conjuntos, vias, linha, latencia;
+    char resto;
+    if (sscanf(texto, "%d,%d,%d,%d%c", &conjuntos, &vias, &linha, &latencia, &resto) != 4)
+        return false;
+    if (conjuntos != 0 && (!potencia_de_dois(conjuntos) || vias < 1 || vias > 64 ||
+                           !potencia_de_dois(linha) || latencia < 1))
+        return false;
+    c->conjuntos = conjuntos;
+    c->vias = vias;
+    c->linha = linha;
+    c->latencia = latencia;
+    return true;
+}
+
+// Lê "nome=quantidade[p|n]"
+bool ler_pool_uf(const char *texto) {
+    char nome[8], modo = 0, resto;
+    int quantidade;
+    int lidos = sscanf(texto, "%7[a-z]=%d%c%c", nome, &quantidade, &modo, &resto);
+    if (lidos < 2 || lidos > 3 || quantidade < 1 || quantidade > MAX_UNIDADES_UF ||
+        (lidos == 3 && modo != 'p' && modo != 'n'))
+        return false;
+    for (int t = 0; t < QTD_TIPOS_UF; t++) {
+        PoolUF *pool = &pools_uf[t];
+        char minusculo[8];
+        int i = 0;
+        for (; pool->nome[i]; i++)
+            minusculo[i] = (char)(pool->nome[i] - 'A' + 'a');
+        minusculo[i] = '\0';
+        if (strcmp(nome, minusculo) != 0)
+            continue;
+        pool->quantidade = quantidade;
+        if (lidos == 3)
+            pool->pipelined = (modo == 'p');
+        return true;
+    }
+    return false;
+}
+
+// Retorna o nome do arquivo de entrada, ou NULL em caso de erro
+const char *ler_argumentos(int argc, char *argv[]) {
+    const char *arquivo = "simulacaoCorrigido.txt";
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        int *destino = NULL;
+        int min = 1, max = 0;
+
+        if (strcmp(arg, "-q") == 0) {
+            config.verboso = false;
+            continue;
+        }
+        if (arg[0] != '-') {
+            arquivo = arg;
+            continue;
+        }
+        if (strcmp(arg, "-L1") == 0 || strcmp(arg, "-L2") == 0) {
+            Cache *c = (arg[2] == '1') ? &cache_l1 : &cache_l2;
+            if (i + 1 >= argc || !ler_geometria_cache(argv[i + 1], c)) {
+                fprintf(stderr, "Valor invalido para %s (use conjuntos,vias,linha,latencia)\n", arg);
+                return NULL;
+            }
+            i++;
+            continue;
+        }
+        if (strcmp(arg, "-o") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Falta o arquivo de -o\n");
+                return NULL;
+            }
+            config.arquivo_metricas = argv[++i];
+            continue;
+        }
+        if (strcmp(arg, "-fu") == 0) {
+            if (i + 1 >= argc || !ler_pool_uf(argv[i + 1])) {
+                fprintf(stderr, "Valor invalido para -fu (ex.: mul=1p, div=1n)\n");
+                return NULL;
+            }
+            i++;
+            continue;
+        }
+        if (strcmp(arg, "-p") == 0) {
+            if (i + 1 >= argc || (preditor = buscar_preditor(argv[i + 1])) == NULL) {
+                fprintf(stderr, "Preditor invalido (use estatico, bimodal ou gshare)\n");
+                return NULL;
+            }
+            i++;
+            continue;
+        }
+
+        if (strcmp(arg, "-e") == 0)      { destino = &config.qtd_estacoes; max = MAX_ESTACOES; }
+        else if (strcmp(arg, "-r") == 0) { destino = &config.tam_rob;      max = MAX_FILA_ROB; }
+        else if (strcmp(arg, "-i") == 0) { destino = &config.n_issue;      max = MAX_FILA_ROB; }
+        else if (strcmp(arg, "-c") == 0) { destino = &config.n_commit;     max = MAX_FILA_ROB; }
+        else if (strcmp(arg, "-m") == 0) { destino = &config.max_ciclos;   min = 0; max = 2147483647; }
+        else if (strcmp(arg, "-t") == 0) { destino = &config.threads;      min = 0; max = MAX_THREADS_MONTADOR; }
+        else if (strcmp(arg, "-b") == 0) { destino = &config.bits_preditor; max = MAX_BITS_PREDITOR; }
+        else if (strcmp(arg, "-s") == 0) { destino = &config.max_especulacao; min = 0; max = MAX_FILA_ROB; }
+        else if (strcmp(arg, "-l") == 0) { destino = &config.tam_lsq;      max = MAX_FILA_LSQ; }
+        else if (strcmp(arg, "-v") == 0) { destino = &config.taxa_verificacao; min = 0; max = 100; }
+        else if (strcmp(arg, "-n") == 0) { destino = &config.intervalo_metricas; max = 2147483647; }
+        else if (strcmp(arg, "-k") == 0) { destino = &config.largura_cdb;  min = 0; max = MAX_ESTACOES + MAX_FILA_LSQ; }
+        else if (strcmp(arg, "-lm") == 0) { destino = &latencia_memoria;   max = 1000000; }
+        else {
+            fprintf(stderr, "Opcao desconhecida: %s\n", arg);
+            return NULL;
+        }
+
+        if (i + 1 >= argc || !ler_inteiro(argv[i + 1], min, max, destino)) {
+            fprintf(stderr, "Valor invalido para %s\n", arg);
+            return NULL;
+        }
+        i++;
+    }
+    return arquivo;
+}
+
+// Main
+
+int main(int argc, char *argv[]) {
+    const char *arquivo = ler_argumentos(argc, argv);
+    if (arquivo == NULL) {
+        mostrar_uso(argv[0]);
+        return 1;
+    }
+
+    int instr_count = montar_programa(arquivo, config.threads);
+    if (instr_count < 0)
+        return 1;
+
+    if (!iniciar_cache(&cache_l1) || !iniciar_cache(&cache_l2)) {
+        fprintf(stderr, "Erro: memoria insuficiente para as caches\n");
+        return 1;
+    }
+
+    if (config.arquivo_metricas != NULL && !abrir_metricas(config.arquivo_metricas))
+        return 1;
+
+    // Contadores começam em "fracamente tomado"
+    memset(contadores_desvio, 2, sizeof(contadores_desvio));
+
+    FuncaoCiclo executar_ciclo = selecionar_motor();
+    LOG("Motor: %s (ER=%d, ROB=%d, issue=%d, commit=%d)\n\n",
+        executar_ciclo == ciclo_generico ? "generico" : "especializado",
+        config.qtd_estacoes, config.tam_rob, config.n_issue, config.n_commit);
 
     while (true) {
-        if (cpu_core.pc >= instr_count) break;
+        // Fim da memória de instruções (só depois de esvaziar o ROB: a busca
+        // pode ter passado do fim em um caminho especulativo)
+        if (cpu_core.pc >= instr_count && cpu_core.rob_contagem == 0) break;
 
-        printf("Ciclo %d\n", cpu_core.ciclo);
-        mostrar_banco_regs();
-        mostrar_estacoes_reserva();
+        if (config.verboso) {
+            printf("Ciclo %lld\n", cpu_core.ciclo);
+            mostrar_banco_regs();
+            mostrar_estacoes_reserva();
+        }
 
-        etapa_despacho(instr_count);
-        etapa_execucao();
-        etapa_finalizacao();
+        executar_ciclo(instr_count);
+        if (metricas.arquivo != NULL)
+            amostrar_metricas();
 
         cpu_core.ciclo++;
-        printf("\n");
+        LOG("\n");
 
-        if (cpu_core.ciclo > 100) {
-            printf("Simulacao excedeu 100 ciclos. Abortando.\n");
+        if (config.max_ciclos > 0 && cpu_core.ciclo > config.max_ciclos) {
+            printf("Simulacao excedeu %d ciclos. Abortando.\n", config.max_ciclos);
             break;
         }
 
-        if (memoria_instrucoes[cpu_core.pc].op == HALT && cpu_core.rob_contagem == 0)
+        if (cpu_core.pc < instr_count && memoria_instrucoes[cpu_core.pc].op == HALT &&
+            cpu_core.rob_contagem == 0)
             break;
     }
 
+    finalizar_metricas(cpu_core.ciclo - 1);
+
     printf("ESTADO FINAL\n");
     mostrar_regs_final();
+    mostrar_estatisticas(cpu_core.ciclo - 1);
     return 0;
 }